@@ -0,0 +1,94 @@
+/**
+ * Times the rendering of decorations by their painters, the same code the
+ * plugin draws them with, for themes that take each of the specialized
+ * background paths. Quads are recorded into the batched renderer. GL calls
+ * are the stubs of the tests, so only the work on the CPU is timed.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+
+#include "firedecor-painter.hpp"
+#include "test-themes.hpp"
+
+using namespace wf::firedecor;
+
+/** Frames rendered before timing, to let the kept storage grow */
+static constexpr int WARMUP_FRAMES = 1000;
+/** Frames timed for each theme in each round */
+static constexpr int TIMED_FRAMES = 20000;
+/**
+ * Rounds timed, going over every theme in each of them, so that whatever else
+ * runs on the machine disturbs them all alike. The fastest round is kept.
+ */
+static constexpr int ROUNDS = 20;
+
+/** The size of the decorations, the view inside of them included */
+static constexpr wf::dimensions_t DECORATION_SIZE = { 820, 645 };
+
+/** A decoration of a theme, with the whole of its frame damaged */
+struct theme_case_t {
+    const char *name;
+    std::unique_ptr<decoration_painter_t> painter;
+    wf::region_t damage;
+    double best = 0;
+};
+
+static theme_case_t make_case(const char *name, stubs::theme_kind_t kind,
+                              std::shared_ptr<decoration_renderer_t> renderer) {
+    auto painter = std::make_unique<decoration_painter_t>(stubs::make_theme(kind),
+        renderer, [] (wlr_box) {});
+    painter->set_title("firedecor background benchmark");
+    painter->set_app_id(stubs::app_id);
+    painter->set_view_state(true, 0);
+    painter->update_decoration_size(false);
+    painter->resize(DECORATION_SIZE);
+
+    wf::region_t damage = painter->get_region();
+    return { name, std::move(painter), std::move(damage) };
+}
+
+/** @return The nanoseconds a frame of the case takes */
+static double time_frames(theme_case_t& c, const wf::render_target_t& fb, int frames) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++) {
+        c.painter->render(fb, { 0, 0 }, c.damage);
+    }
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    return elapsed.count() / frames;
+}
+
+int main() {
+    stubs::setup_home();
+
+    auto renderer = std::make_shared<decoration_renderer_t>();
+    renderer->set_batched(true);
+
+    theme_case_t cases[] = {
+        make_case("no outline", stubs::THEME_PLAIN, renderer),
+        make_case("outline", stubs::THEME_OUTLINE, renderer),
+        make_case("border image", stubs::THEME_BORDER_IMAGE, renderer),
+    };
+
+    wf::render_target_t fb;
+    fb.geometry = { 0, 0, 1920, 1080 };
+    for (auto& c : cases) {
+        time_frames(c, fb, WARMUP_FRAMES);
+    }
+
+    for (int round = 0; round < ROUNDS; round++) {
+        for (auto& c : cases) {
+            double ns = time_frames(c, fb, TIMED_FRAMES);
+            c.best = (round == 0) ? ns : std::min(c.best, ns);
+        }
+    }
+
+    for (const auto& c : cases) {
+        std::printf("%-12s  %8.1f ns/frame\n", c.name, c.best);
+    }
+
+    return 0;
+}
@@ -0,0 +1,549 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "firedecor-atlas.hpp"
+
+namespace wf {
+namespace firedecor {
+std::shared_ptr<texture_atlas_t> texture_atlas_t::get() {
+    static std::weak_ptr<texture_atlas_t> instance;
+
+    auto atlas = instance.lock();
+    if (!atlas) {
+        atlas = std::make_shared<texture_atlas_t>();
+        instance = atlas;
+    }
+
+    return atlas;
+}
+
+texture_atlas_t::~texture_atlas_t() {
+    if (has_upload_buffers) {
+        OpenGL::render_begin();
+        GL_CALL(glDeleteBuffers(UPLOAD_BUFFER_COUNT, upload_buffers));
+        OpenGL::render_end();
+    }
+
+    for (auto& page : pages) {
+        if (page.tex != (GLuint)-1) {
+            pool->give_back(page.tex, { ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE });
+        }
+    }
+}
+
+bool texture_atlas_t::allocate(page_t& page, int width, int height,
+                               wf::point_t& position) {
+    /** The shortest shelf that fits, so tall shelves are kept for tall assets */
+    shelf_t *best = nullptr;
+    std::pair<int, int> *best_span = nullptr;
+    for (auto& shelf : page.shelves) {
+        if ((shelf.height < height) || (best && best->height <= shelf.height)) {
+            continue;
+        }
+
+        for (auto& span : shelf.free) {
+            if (span.second >= width) {
+                best = &shelf;
+                best_span = &span;
+                break;
+            }
+        }
+    }
+
+    if (best) {
+        position = { best_span->first, best->y };
+        best_span->first  += width;
+        best_span->second -= width;
+        if (best_span->second == 0) {
+            best->free.erase(best->free.begin() + (best_span - best->free.data()));
+        }
+    } else if (page.used_height + height <= ATLAS_PAGE_SIZE) {
+        page.shelves.push_back({ page.used_height, height,
+                                 { { width, ATLAS_PAGE_SIZE - width } } });
+        position = { 0, page.used_height };
+        page.used_height += height;
+    } else {
+        return false;
+    }
+
+    page.used_area += width * height;
+    return true;
+}
+
+void texture_atlas_t::deallocate(page_t& page, wf::geometry_t box) {
+    auto shelf = std::find_if(page.shelves.begin(), page.shelves.end(),
+                              [&](const shelf_t& s) { return s.y == box.y; });
+    if (shelf == page.shelves.end()) {
+        return;
+    }
+
+    /** Add the span back, merging it with its free neighbours */
+    auto& free = shelf->free;
+    free.push_back({ box.x, box.width });
+    std::sort(free.begin(), free.end());
+    for (size_t i = 1; i < free.size();) {
+        if (free[i - 1].first + free[i - 1].second == free[i].first) {
+            free[i - 1].second += free[i].second;
+            free.erase(free.begin() + i);
+        } else {
+            i++;
+        }
+    }
+    page.used_area -= box.width * box.height;
+
+    /** Give fully free shelves at the bottom back to the page */
+    while (!page.shelves.empty()) {
+        auto& last = page.shelves.back();
+        if ((last.free.size() != 1) || (last.free[0].second != ATLAS_PAGE_SIZE)) {
+            break;
+        }
+        page.used_height = last.y;
+        page.shelves.pop_back();
+    }
+}
+
+GLuint texture_atlas_t::create_page_texture() {
+    wf::dimensions_t size = { ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE };
+    return pool->lease(size);
+}
+
+bool texture_atlas_t::defragment(int index) {
+    std::vector<atlas_entry_t*> moved;
+    for (auto& entry : entries) {
+        if (entry->page == index) {
+            moved.push_back(entry.get());
+        }
+    }
+
+    /** Tallest first, which leaves the least space unused in each shelf */
+    std::sort(moved.begin(), moved.end(), [](auto *a, auto *b) {
+        return a->box.height > b->box.height;
+    });
+
+    page_t page;
+    std::vector<wf::point_t> positions(moved.size());
+    for (size_t i = 0; i < moved.size(); i++) {
+        if (!allocate(page, moved[i]->box.width + 2 * ATLAS_PADDING,
+                      moved[i]->box.height + 2 * ATLAS_PADDING, positions[i])) {
+            return false;
+        }
+    }
+
+    OpenGL::render_begin();
+    page.tex = create_page_texture();
+
+    /** Copy every asset from the old texture, through a framebuffer */
+    GLint previous_fb;
+    GLuint fb;
+    GL_CALL(glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous_fb));
+    GL_CALL(glGenFramebuffers(1, &fb));
+    GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, fb));
+    GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                   GL_TEXTURE_2D, pages[index].tex, 0));
+    GL_CALL(glBindTexture(GL_TEXTURE_2D, page.tex));
+    for (size_t i = 0; i < moved.size(); i++) {
+        auto& box = moved[i]->box;
+        GL_CALL(glCopyTexSubImage2D(GL_TEXTURE_2D, 0, positions[i].x, positions[i].y,
+                                    box.x - ATLAS_PADDING, box.y - ATLAS_PADDING,
+                                    box.width + 2 * ATLAS_PADDING,
+                                    box.height + 2 * ATLAS_PADDING));
+        box.x = positions[i].x + ATLAS_PADDING;
+        box.y = positions[i].y + ATLAS_PADDING;
+    }
+    GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, previous_fb));
+    GL_CALL(glDeleteFramebuffers(1, &fb));
+    OpenGL::render_end();
+
+    pool->give_back(pages[index].tex, { ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE });
+
+    pages[index] = std::move(page);
+    return true;
+}
+
+void texture_atlas_t::release_page(int index) {
+    pool->give_back(pages[index].tex, { ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE });
+    pages[index] = {};
+
+    /** Entries refer to pages by index, so only the last ones can go */
+    while (!pages.empty() && (pages.back().tex == (GLuint)-1)) {
+        pages.pop_back();
+    }
+}
+
+void texture_atlas_t::init_upload_buffers() {
+    if (checked_upload_buffers) {
+        return;
+    }
+    checked_upload_buffers = true;
+
+    /** Pixel buffers are only core from GLES 3 onwards */
+    auto *version = (const char*)glGetString(GL_VERSION);
+    int major = 0;
+    if (version && (std::sscanf(version, "OpenGL ES %d", &major) == 1) &&
+        (major >= 3)) {
+        GL_CALL(glGenBuffers(UPLOAD_BUFFER_COUNT, upload_buffers));
+        has_upload_buffers = true;
+    }
+}
+
+void texture_atlas_t::upload_box(GLuint tex, wf::geometry_t box,
+                                 const uint32_t *data, int stride) {
+    size_t bytes = (size_t)box.width * box.height * 4;
+    count_upload(bytes);
+    init_upload_buffers();
+
+    GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
+    GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+
+    if (has_upload_buffers && (bytes >= UPLOAD_BUFFER_MIN_BYTES)) {
+        /**
+         * Orphaning the buffer means the driver never waits for the upload that
+         * used it before, and the copy to the texture happens asynchronously.
+         */
+        GL_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER,
+                             upload_buffers[next_upload_buffer]));
+        next_upload_buffer = (next_upload_buffer + 1) % UPLOAD_BUFFER_COUNT;
+        GL_CALL(glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr,
+                             GL_STREAM_DRAW));
+        auto *mapped = (uint32_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+                                                   GL_MAP_WRITE_BIT |
+                                                   GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (mapped) {
+            for (int y = 0; y < box.height; y++) {
+                std::memcpy(mapped + y * box.width, data + y * stride,
+                            box.width * 4);
+            }
+            GL_CALL(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+            GL_CALL(glTexSubImage2D(GL_TEXTURE_2D, 0, box.x, box.y, box.width,
+                                    box.height, GL_RGBA, GL_UNSIGNED_BYTE,
+                                    nullptr));
+            GL_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+            return;
+        }
+        GL_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+    }
+
+    if (stride == box.width) {
+        GL_CALL(glTexSubImage2D(GL_TEXTURE_2D, 0, box.x, box.y, box.width,
+                                box.height, GL_RGBA, GL_UNSIGNED_BYTE, data));
+    } else {
+        for (int y = 0; y < box.height; y++) {
+            GL_CALL(glTexSubImage2D(GL_TEXTURE_2D, 0, box.x, box.y + y, box.width,
+                                    1, GL_RGBA, GL_UNSIGNED_BYTE,
+                                    data + y * stride));
+        }
+    }
+}
+
+void texture_atlas_t::count_upload(size_t bytes) {
+    stats.total_bytes += bytes;
+    window_bytes += bytes;
+
+    auto now = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        now - window_start).count();
+    if (elapsed >= 1000) {
+        stats.bytes_per_second = window_bytes * 1000 / elapsed;
+        window_bytes = 0;
+        window_start = now;
+    }
+}
+
+upload_stats_t texture_atlas_t::get_upload_stats() const {
+    auto result  = stats;
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - window_start).count();
+
+    /** Without uploads for a while, the last measure is no longer accurate */
+    if (elapsed >= 2000) {
+        result.bytes_per_second = window_bytes * 1000 / elapsed;
+    }
+
+    return result;
+}
+
+void texture_atlas_t::upload_padded(GLuint tex, wf::dimensions_t tex_size,
+                                    wf::geometry_t box, cairo_surface_t *surface) {
+    cairo_surface_flush(surface);
+    auto *data = (uint32_t*)cairo_image_surface_get_data(surface);
+    int stride = cairo_image_surface_get_stride(surface) / 4;
+    const auto& b = box;
+    bool top    = b.y > 0, bottom = b.y + b.height < tex_size.height;
+    bool left   = b.x > 0, right = b.x + b.width < tex_size.width;
+
+    OpenGL::render_begin();
+    /** The asset itself, and copies of its top and bottom rows */
+    upload_box(tex, b, data, stride);
+    if (top) {
+        upload_box(tex, { b.x, b.y - 1, b.width, 1 }, data, stride);
+    }
+    if (bottom) {
+        upload_box(tex, { b.x, b.y + b.height, b.width, 1 },
+                   data + (b.height - 1) * stride, stride);
+    }
+
+    /** Copies of its left and right columns, corners included */
+    int y0 = top ? -1 : 0;
+    int y1 = bottom ? b.height + 1 : b.height;
+    column.resize(y1 - y0);
+    for (auto x : { 0, b.width - 1 }) {
+        if (((x == 0) && !left) || ((x != 0) && !right)) {
+            continue;
+        }
+
+        for (int y = y0; y < y1; y++) {
+            column[y - y0] = data[std::clamp(y, 0, b.height - 1) * stride + x];
+        }
+        int target_x = (x == 0) ? b.x - 1 : b.x + b.width;
+        upload_box(tex, { target_x, b.y + y0, 1, y1 - y0 }, column.data(), 1);
+    }
+    OpenGL::render_end();
+}
+
+void texture_atlas_t::update(const atlas_entry_t *entry, cairo_surface_t *surface) {
+    upload_padded(pages[entry->page].tex, { ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE },
+                  entry->box, surface);
+}
+
+atlas_entry_t *texture_atlas_t::add(cairo_surface_t *surface) {
+    int width  = cairo_image_surface_get_width(surface) + 2 * ATLAS_PADDING;
+    int height = cairo_image_surface_get_height(surface) + 2 * ATLAS_PADDING;
+    if ((width > ATLAS_PAGE_SIZE) || (height > ATLAS_PAGE_SIZE) ||
+        (width <= 2 * ATLAS_PADDING) || (height <= 2 * ATLAS_PADDING)) {
+        return nullptr;
+    }
+
+    wf::point_t position;
+    int index = -1;
+    for (int i = 0; i < (int)pages.size() && index < 0; i++) {
+        if ((pages[i].tex != (GLuint)-1) &&
+            allocate(pages[i], width, height, position)) {
+            index = i;
+        }
+    }
+
+    /** Pages with enough free space are only fragmented, so pack them again */
+    const int page_area = ATLAS_PAGE_SIZE * ATLAS_PAGE_SIZE;
+    for (int i = 0; i < (int)pages.size() && index < 0; i++) {
+        if ((pages[i].tex != (GLuint)-1) &&
+            (page_area - pages[i].used_area >= page_area / 2) && defragment(i) &&
+            allocate(pages[i], width, height, position)) {
+            index = i;
+        }
+    }
+
+    if (index < 0) {
+        /** A page released before, or a new one */
+        int slot = std::find_if(pages.begin(), pages.end(), [](const page_t& p) {
+            return p.tex == (GLuint)-1;
+        }) - pages.begin();
+        if (slot < ATLAS_MAX_PAGES) {
+            if (slot == (int)pages.size()) {
+                pages.emplace_back();
+            }
+
+            OpenGL::render_begin();
+            pages[slot].tex = create_page_texture();
+            OpenGL::render_end();
+            if (allocate(pages[slot], width, height, position)) {
+                index = slot;
+            }
+        }
+    }
+
+    if (index < 0) {
+        return nullptr;
+    }
+
+    entries.push_back(std::make_unique<atlas_entry_t>());
+    auto *entry = entries.back().get();
+    entry->page = index;
+    entry->box  = {
+        position.x + ATLAS_PADDING, position.y + ATLAS_PADDING,
+        width - 2 * ATLAS_PADDING, height - 2 * ATLAS_PADDING
+    };
+    update(entry, surface);
+
+    return entry;
+}
+
+void texture_atlas_t::remove(atlas_entry_t *entry) {
+    wf::geometry_t padded = {
+        entry->box.x - ATLAS_PADDING, entry->box.y - ATLAS_PADDING,
+        entry->box.width + 2 * ATLAS_PADDING, entry->box.height + 2 * ATLAS_PADDING
+    };
+    deallocate(pages[entry->page], padded);
+
+    /** The first page stays, as it is needed again as soon as anything is added */
+    if ((entry->page > 0) && (pages[entry->page].used_area == 0)) {
+        release_page(entry->page);
+    }
+
+    auto it = std::find_if(entries.begin(), entries.end(),
+                           [&](const auto& e) { return e.get() == entry; });
+    if (it != entries.end()) {
+        std::swap(*it, entries.back());
+        entries.pop_back();
+    }
+}
+
+void texture_atlas_t::set_keep_pixels(bool keep) {
+    keep_pixels = keep;
+}
+
+bool texture_atlas_t::keeps_pixels() const {
+    return keep_pixels;
+}
+
+GLuint texture_atlas_t::get_texture(const atlas_entry_t *entry) const {
+    return pages[entry->page].tex;
+}
+
+atlas_texture_t::~atlas_texture_t() {
+    release();
+}
+
+atlas_texture_t::atlas_texture_t(atlas_texture_t&& other) {
+    *this = std::move(other);
+}
+
+atlas_texture_t& atlas_texture_t::operator =(atlas_texture_t&& other) {
+    if (this != &other) {
+        release();
+        atlas = std::move(other.atlas);
+        pool  = std::move(other.pool);
+        entry = other.entry;
+        own   = other.own;
+        own_storage = other.own_storage;
+        kept  = other.kept;
+        size  = other.size;
+        other.entry = nullptr;
+        other.own   = -1;
+        other.kept  = nullptr;
+        other.size  = { 0, 0 };
+    }
+
+    return *this;
+}
+
+void atlas_texture_t::upload(cairo_surface_t *surface) {
+    wf::dimensions_t new_size = {
+        cairo_image_surface_get_width(surface),
+        cairo_image_surface_get_height(surface)
+    };
+
+    if (!atlas) {
+        atlas = texture_atlas_t::get();
+        pool  = texture_pool_t::get();
+    }
+
+    if (atlas->keeps_pixels() && (surface != kept)) {
+        cairo_surface_reference(surface);
+        if (kept) {
+            cairo_surface_destroy(kept);
+        }
+        kept = surface;
+    }
+
+    /** Same size, or same bucket for own textures, so only the pixels change */
+    if (entry && (new_size == size)) {
+        atlas->update(entry, surface);
+        return;
+    } else if ((own != (GLuint)-1) &&
+               (texture_pool_t::bucket_size(new_size) == own_storage)) {
+        size = new_size;
+        atlas->upload_padded(own, own_storage, { 0, 0, size.width, size.height },
+                             surface);
+        return;
+    }
+
+    release_texture();
+    size = new_size;
+    if ((size.width <= 0) || (size.height <= 0)) {
+        return;
+    }
+
+    entry = atlas->add(surface);
+    if (!entry) {
+        own_storage = size;
+        OpenGL::render_begin();
+        own = pool->lease(own_storage);
+        OpenGL::render_end();
+        atlas->upload_padded(own, own_storage, { 0, 0, size.width, size.height },
+                             surface);
+    }
+}
+
+void atlas_texture_t::release() {
+    release_texture();
+    if (kept) {
+        cairo_surface_destroy(kept);
+        kept = nullptr;
+    }
+}
+
+void atlas_texture_t::release_texture() {
+    if (entry) {
+        atlas->remove(entry);
+        entry = nullptr;
+    }
+
+    if (own != (GLuint)-1) {
+        pool->give_back(own, own_storage);
+        own = -1;
+    }
+
+    size = { 0, 0 };
+}
+
+GLuint atlas_texture_t::get_texture() const {
+    if (entry) {
+        return atlas->get_texture(entry);
+    } else if (own != (GLuint)-1) {
+        return own;
+    }
+
+    return -1;
+}
+
+gl_geometry atlas_texture_t::get_uv(uint32_t bits) const {
+    return get_uv(bits, { 0, 0, size.width, size.height });
+}
+
+gl_geometry atlas_texture_t::get_uv(uint32_t bits, wf::geometry_t part) const {
+    float u0 = 0, v0 = 0, u1 = 1, v1 = 1;
+    if (entry) {
+        const float s = ATLAS_PAGE_SIZE;
+        u0 = (entry->box.x + part.x) / s;
+        v0 = (entry->box.y + part.y) / s;
+        u1 = (entry->box.x + part.x + part.width) / s;
+        v1 = (entry->box.y + part.y + part.height) / s;
+    } else if (own != (GLuint)-1) {
+        u0 = (float)part.x / own_storage.width;
+        v0 = (float)part.y / own_storage.height;
+        u1 = (float)(part.x + part.width) / own_storage.width;
+        v1 = (float)(part.y + part.height) / own_storage.height;
+    }
+
+    /** Same orientation as a whole texture drawn without TEX_GEOMETRY */
+    gl_geometry uv = { u0, v1, u1, v0 };
+    if (bits & OpenGL::TEXTURE_TRANSFORM_INVERT_X) {
+        std::swap(uv.x1, uv.x2);
+    }
+    if (bits & OpenGL::TEXTURE_TRANSFORM_INVERT_Y) {
+        std::swap(uv.y1, uv.y2);
+    }
+
+    return uv;
+}
+
+wf::dimensions_t atlas_texture_t::get_size() const {
+    return size;
+}
+
+cairo_surface_t *atlas_texture_t::get_surface() const {
+    return kept;
+}
+}
+}
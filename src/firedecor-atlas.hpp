@@ -0,0 +1,245 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <cairo.h>
+#include <wayfire/opengl.hpp>
+
+#include "firedecor-pool.hpp"
+
+namespace wf {
+namespace firedecor {
+
+/** The width and height of each atlas page, in pixels */
+static constexpr int ATLAS_PAGE_SIZE = 2048;
+/** The maximum amount of pages, assets that don't fit get a texture of their own */
+static constexpr int ATLAS_MAX_PAGES = 4;
+/** Pixels around each asset, filled with copies of its edges to avoid bleeding */
+static constexpr int ATLAS_PADDING = 1;
+/** The amount of pixel buffers uploads rotate through */
+static constexpr int UPLOAD_BUFFER_COUNT = 4;
+/** Uploads smaller than this are not worth going through a pixel buffer */
+static constexpr size_t UPLOAD_BUFFER_MIN_BYTES = 4096;
+
+/** Statistics about the pixels decorations send to the GPU */
+struct upload_stats_t {
+    /** Bytes uploaded since the atlas was created */
+    uint64_t total_bytes = 0;
+    /** Bytes uploaded per second, measured over at least the last second */
+    uint64_t bytes_per_second = 0;
+};
+
+/** The sizes of the edges of a nine-slice image, like CSS's border-image */
+struct slice_insets_t {
+    int top, left, bottom, right;
+};
+
+/** A rectangle of an atlas page, holding a single asset */
+struct atlas_entry_t {
+    /** The index of the page the asset is in */
+    int page;
+    /** The box of the asset inside the page, without the padding */
+    wf::geometry_t box;
+};
+
+/**
+ * A set of large textures, in which the small assets of every decoration are
+ * packed, in order to avoid many small allocations and texture binds.
+ *
+ * Each page is packed in shelves, rows of assets with similar heights. Space
+ * freed by removed assets is reused, and when a page becomes too fragmented to
+ * hold a new asset, its remaining assets are packed again into a new texture.
+ *
+ * Every upload of decoration pixels goes through here. When the context
+ * supports it, they are streamed through pixel buffers, so the driver can copy
+ * them to the texture asynchronously.
+ */
+class texture_atlas_t {
+  public:
+    /** @return The atlas shared by every decoration, created on demand */
+    static std::shared_ptr<texture_atlas_t> get();
+
+    texture_atlas_t() = default;
+    ~texture_atlas_t();
+
+    texture_atlas_t(const texture_atlas_t &) = delete;
+    texture_atlas_t(texture_atlas_t &&) = delete;
+    texture_atlas_t& operator =(const texture_atlas_t&) = delete;
+    texture_atlas_t& operator =(texture_atlas_t&&) = delete;
+
+    /**
+     * Place a cairo surface in the atlas.
+     * @return The entry holding the surface, or nullptr if it doesn't fit.
+     */
+    atlas_entry_t *add(cairo_surface_t *surface);
+
+    /** Remove an entry, so its space can be reused */
+    void remove(atlas_entry_t *entry);
+
+    /**
+     * Replace the pixels of an entry with a surface of the same size, keeping
+     * its place in the atlas.
+     */
+    void update(const atlas_entry_t *entry, cairo_surface_t *surface);
+
+    /**
+     * Copy the pixels of a surface into a box of a texture, and copies of its
+     * edges around it, where they fit in the texture.
+     */
+    void upload_padded(GLuint tex, wf::dimensions_t tex_size, wf::geometry_t box,
+                       cairo_surface_t *surface);
+
+    /**
+     * Upload pixels to a box of an existing texture, keeping its storage.
+     * @param data The pixels, with rows of stride pixels.
+     * Must be called with the GL context current.
+     */
+    void upload_box(GLuint tex, wf::geometry_t box, const uint32_t *data,
+                    int stride);
+
+    /** @return Statistics of the uploads made so far */
+    upload_stats_t get_upload_stats() const;
+
+    /**
+     * Make assets keep their cairo surfaces after uploading them, for the
+     * software backend, which composites them on the CPU.
+     */
+    void set_keep_pixels(bool keep);
+
+    /** @return True if assets keep their cairo surfaces */
+    bool keeps_pixels() const;
+
+    /** @return The texture of the page that holds the entry */
+    GLuint get_texture(const atlas_entry_t *entry) const;
+
+  private:
+    /** A row of a page, with the horizontal spans that are still free */
+    struct shelf_t {
+        int y, height;
+        std::vector<std::pair<int, int>> free;
+    };
+
+    /** Pages emptied by remove() lose their texture, keeping their index */
+    struct page_t {
+        GLuint tex = -1;
+        std::vector<shelf_t> shelves;
+        int used_height = 0;
+        /** The area of every asset in the page, with padding */
+        int used_area = 0;
+    };
+
+    std::shared_ptr<texture_pool_t> pool = texture_pool_t::get();
+
+    std::vector<page_t> pages;
+    std::vector<std::unique_ptr<atlas_entry_t>> entries;
+
+    /** Pixel buffers for streaming uploads, if the context supports them */
+    GLuint upload_buffers[UPLOAD_BUFFER_COUNT];
+    int next_upload_buffer = 0;
+    bool checked_upload_buffers = false;
+    bool has_upload_buffers = false;
+
+    bool keep_pixels = false;
+
+    upload_stats_t stats;
+    uint64_t window_bytes = 0;
+    std::chrono::steady_clock::time_point window_start =
+        std::chrono::steady_clock::now();
+
+    /** Storage for the columns of padding, kept between uploads */
+    std::vector<uint32_t> column;
+
+    /**
+     * Add the bytes of one upload_box() call to the statistics. That is every
+     * upload to the atlas and to own textures, padding included, but not the
+     * copies made on the GPU when defragmenting.
+     */
+    void count_upload(size_t bytes);
+
+    /** Check if pixel buffers can be used, creating them if so */
+    void init_upload_buffers();
+
+    /** Find space for a padded box in a page, without touching its texture */
+    static bool allocate(page_t& page, int width, int height,
+                         wf::point_t& position);
+    /** Return the space of a padded box to a page */
+    static void deallocate(page_t& page, wf::geometry_t box);
+
+    /** @return A page texture from the pool, with undefined contents */
+    GLuint create_page_texture();
+
+    /** Pack the entries of a page again, in a new texture */
+    bool defragment(int index);
+
+    /** Give the texture of an empty page back to the pool */
+    void release_page(int index);
+};
+
+/**
+ * An asset of a decoration. It lives in the shared atlas when it fits there, and
+ * in a texture of its own otherwise.
+ */
+class atlas_texture_t {
+  public:
+    atlas_texture_t() = default;
+    ~atlas_texture_t();
+
+    atlas_texture_t(const atlas_texture_t &) = delete;
+    atlas_texture_t& operator =(const atlas_texture_t&) = delete;
+    atlas_texture_t(atlas_texture_t&& other);
+    atlas_texture_t& operator =(atlas_texture_t&& other);
+
+    /**
+     * Replace the contents of the texture with a cairo surface. If the size
+     * didn't change, the texture's storage is kept and only its pixels change.
+     */
+    void upload(cairo_surface_t *surface);
+
+    /** Free the texture, or its space in the atlas */
+    void release();
+
+    /** @return The GL texture to sample from, or (GLuint)-1 if there is none */
+    GLuint get_texture() const;
+
+    /**
+     * @return The texture coordinates of the asset, to be used with
+     * OpenGL::TEXTURE_USE_TEX_GEOMETRY. The inversion bits are applied here,
+     * since the texture may be shared with other assets.
+     */
+    gl_geometry get_uv(uint32_t bits = 0) const;
+
+    /** @return The texture coordinates of a part of the asset, in its pixels */
+    gl_geometry get_uv(uint32_t bits, wf::geometry_t part) const;
+
+    /** @return The size of the asset, in pixels */
+    wf::dimensions_t get_size() const;
+
+    /**
+     * @return The surface last uploaded, if the atlas keeps pixels, or nullptr.
+     * It is owned by the texture.
+     */
+    cairo_surface_t *get_surface() const;
+
+  private:
+    std::shared_ptr<texture_atlas_t> atlas;
+    atlas_entry_t *entry = nullptr;
+
+    /**
+     * Leased from the pool when the asset doesn't fit in the atlas, its storage
+     * may be larger than the asset.
+     */
+    std::shared_ptr<texture_pool_t> pool;
+    GLuint own = -1;
+    wf::dimensions_t own_storage = { 0, 0 };
+
+    /** A reference to the surface last uploaded, if the atlas keeps pixels */
+    cairo_surface_t *kept = nullptr;
+
+    /** Free the texture, or its space in the atlas, but not the kept surface */
+    void release_texture();
+
+    wf::dimensions_t size = { 0, 0 };
+};
+}
+}
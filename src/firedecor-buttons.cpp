@@ -2,6 +2,7 @@
 #include <wayfire/plugins/common/cairo-util.hpp>
 
 #include "firedecor-buttons.hpp"
+#include "firedecor-renderer.hpp"
 #include "firedecor-theme.hpp"
 
 #define HOVERED  1.0
@@ -16,6 +17,7 @@ button_t::button_t(const decoration_theme_t& t, std::function<void()> damage) :
 void button_t::set_button_type(button_type_t type) {
     this->type = type;
     this->hover.animate(0, 0);
+    this->shade = 0;
     update_texture();
     add_idle_damage();
 }
@@ -44,9 +46,9 @@ void button_t::set_hover(bool is_hovered) {
     this->is_hovered = is_hovered;
     if (!this->is_pressed) {
         if (is_hovered) {
-            this->hover.animate(HOVERED);
+            set_shade(HOVERED);
         } else {
-            this->hover.animate(NORMAL);
+            set_shade(NORMAL);
         }
     }
 
@@ -61,33 +63,54 @@ void button_t::set_hover(bool is_hovered) {
 void button_t::set_pressed(bool is_pressed) {
     this->is_pressed = is_pressed;
     if (is_pressed) {
-        this->hover.animate(PRESSED);
+        set_shade(PRESSED);
     } else {
-        this->hover.animate(is_hovered ? HOVERED : NORMAL);
+        set_shade(is_hovered ? HOVERED : NORMAL);
     }
 
     add_idle_damage();
 }
 
-void button_t::render(const wf::render_target_t& fb, wf::geometry_t geometry,
-    				  wf::geometry_t scissor) {
-    OpenGL::render_begin(fb);
-    fb.logic_scissor(scissor);
-    OpenGL::render_texture(button_texture.tex, fb, geometry, {1, 1, 1, 1},
-        OpenGL::TEXTURE_TRANSFORM_INVERT_Y);
-    OpenGL::render_end();
+void button_t::render(decoration_renderer_t& renderer, wf::geometry_t geometry,
+                      double scale) {
+    auto& texture = textures[scale];
+    if (!texture.current) {
+        auto surface = theme.form_button(type, get_shade(), active, maximized,
+                                         scale);
+        texture.tex.upload(surface);
+        texture.current = true;
+        cairo_surface_destroy(surface);
+    }
+
+    renderer.add_texture(LAYER_CONTENT, texture.tex, geometry,
+                         OpenGL::TEXTURE_TRANSFORM_INVERT_Y);
 
     if (this->hover.running()) {
         add_idle_damage();
     }
 }
 
+void button_t::drop_scale(double scale) {
+    textures.erase(scale);
+}
+
 void button_t::update_texture() {
-    auto surface = theme.form_button(type, hover, active, maximized);
-    OpenGL::render_begin();
-    cairo_surface_upload_to_texture(surface, this->button_texture);
-    OpenGL::render_end();
-    cairo_surface_destroy(surface);
+    for (auto& [scale, texture] : textures) {
+        texture.current = false;
+    }
+}
+
+void button_t::set_shade(double target) {
+    if (theme.get_quality() == QUALITY_FULL) {
+        this->hover.animate(target);
+    } else {
+        /** Without the animation, the texture is drawn once per state change */
+        this->shade = target;
+    }
+}
+
+double button_t::get_shade() {
+    return (theme.get_quality() == QUALITY_FULL) ? (double)hover : shade;
 }
 
 void button_t::add_idle_damage() {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <map>
 #include <string>
 #include <wayfire/util.hpp>
 #include <wayfire/opengl.hpp>
@@ -12,9 +13,12 @@
 
 #include <cairo/cairo.h>
 
+#include "firedecor-atlas.hpp"
+
 namespace wf {
 namespace firedecor {
 class decoration_theme_t;
+class decoration_renderer_t;
 
 enum button_type_t {
     BUTTON_CLOSE,
@@ -65,22 +69,33 @@ class button_t {
     void set_pressed(bool is_pressed);
 
     /**
-     * Render the button on the given framebuffer at the given coordinates.
+     * Render the button with the given renderer at the given coordinates.
      * Precondition: set_button_type() has been called, otherwise result is no-op
      *
-     * @param buffer The target framebuffer
+     * @param renderer The renderer of the decoration's output
      * @param geometry The geometry of the button, in logical coordinates
-     * @param scissor The scissor rectangle to render.
+     * @param scale The scale of the framebuffer, the button is rasterized for
+     * it if it wasn't yet
      */
-    void render(const wf::render_target_t& buffer, wf::geometry_t geometry,
-        wf::geometry_t scissor);
+    void render(decoration_renderer_t& renderer, wf::geometry_t geometry,
+                double scale);
+
+    /** Free the texture rasterized for a scale, once no output uses it */
+    void drop_scale(double scale);
 
   private:
  	const decoration_theme_t& theme;
 
     /* Whether the button needs repaint */
     button_type_t type;
-    wf::simple_texture_t button_texture;
+    /** A texture of the button, rasterized for one scale */
+    struct scaled_texture_t {
+        atlas_texture_t tex;
+        /** False once the state changes, so it is drawn again in place */
+        bool current = false;
+    };
+    /** The textures of the button, for each scale it was drawn at */
+    std::map<double, scaled_texture_t> textures;
 
     /* Whether the button is currently being hovered */
     bool is_hovered = false;
@@ -93,6 +108,13 @@ class button_t {
     
     /* The shade of button background to use. */
     wf::animation::simple_animation_t hover{wf::create_option(100)};
+    /* The shade of button background, when hover animations are disabled */
+    double shade = 0.0;
+
+    /** Change the shade, animating it if the theme's quality allows it */
+    void set_shade(double target);
+    /** @return The current shade of the button background */
+    double get_shade();
 
     std::function<void()> damage_callback;
     wf::wl_idle_call idle_damage;
@@ -100,7 +122,8 @@ class button_t {
     void add_idle_damage();
 
     /**
-     * Redraw the button surface and store it as a texture
+     * Mark the textures of every scale as outdated, so they are drawn again
+     * with the current state the next time they are rendered
      */
     void update_texture();
 };
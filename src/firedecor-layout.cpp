@@ -6,81 +6,207 @@
 #include "firedecor-layout.hpp"
 #include "firedecor-theme.hpp"
 
-#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+#include <tuple>
 
 namespace wf {
 namespace firedecor {
-/** Initialize a new decoration area holding an icon */
-decoration_area_t::decoration_area_t(decoration_area_type_t type,
-                                     wf::geometry_t g, edge_t edge) {
-    this->type     = type;
-    this->geometry = g;
-    this->edge     = edge;
+accent_style_t accent_style_t::parse(const std::string& symbol) {
+    accent_style_t style;
+    if (symbol == "a") {
+        style.rounded = ACCENT_CORNER_ALL;
+        return style;
+    }
+
+    /** In the same order as the accent_corner_t bits */
+    const char *corners[4] = { "br", "tr", "tl", "bl" };
+    for (int i = 0; i < 4; i++) {
+        if (symbol.find(corners[i]) != std::string::npos) {
+            style.rounded |= (1 << i);
+        }
+    }
+
+    /** The first diagonal is on the left of the accent, the second on the right */
+    for (int i = 0; auto c : symbol) {
+        if (c == '/') {
+            style.diagonal |= (i == 0) ? ACCENT_CORNER_TL : ACCENT_CORNER_BR;
+            i++;
+        } else if (c == '\\') {
+            style.diagonal |= (i == 0) ? ACCENT_CORNER_BL : ACCENT_CORNER_TR;
+            i++;
+        } else if (c == '!') {
+            i++;
+        }
+    }
+
+    return style;
+}
+
+size_t area_arrays_t::size() const {
+    return types.size();
 }
 
-/** Initialize a new decoration area holding a title */
-decoration_area_t::decoration_area_t(wf::geometry_t g, wf::geometry_t g_dots,
-                                     edge_t edge) {
-    this->type     = DECORATION_AREA_TITLE;
-    this->geometry = g;
-    this->dots_geometry = g_dots;
-    this->edge     = edge;
+void area_arrays_t::clear() {
+    types.clear();
+    geometries.clear();
+    dots_geometries.clear();
+    edges.clear();
+    transforms.clear();
+    styles.clear();
+    buttons.clear();
 }
 
-/** Initialize a new decoration area holding a button */
-decoration_area_t::decoration_area_t(wf::geometry_t g,
-                                     std::function<void(wlr_box)> damage_callback,
-                                	 const decoration_theme_t& theme) {
-    this->type     = DECORATION_AREA_BUTTON;
-    this->geometry = g;
+bool area_arrays_t::same_area(const area_arrays_t& other, size_t i) const {
+    const auto& m = transforms[i];
+    const auto& n = other.transforms[i];
+    return (types[i] == other.types[i]) && (geometries[i] == other.geometries[i]) &&
+           (dots_geometries[i] == other.dots_geometries[i]) &&
+           (edges[i] == other.edges[i]) && (buttons[i] == other.buttons[i]) &&
+           (m.xx == n.xx) && (m.xy == n.xy) && (m.yx == n.yx) && (m.yy == n.yy) &&
+           (styles[i].rounded == other.styles[i].rounded) &&
+           (styles[i].diagonal == other.styles[i].diagonal);
+}
 
-    this->button = std::make_unique<button_t>(theme, std::bind(damage_callback, g));
+int area_arrays_t::add(decoration_area_type_t type, wf::geometry_t g, edge_t edge,
+                       wf::geometry_t dots_g, matrix<int> m, accent_style_t style,
+                       int button) {
+    types.push_back(type);
+    geometries.push_back(g);
+    dots_geometries.push_back(dots_g);
+    edges.push_back(edge);
+    transforms.push_back(m);
+    styles.push_back(style);
+    buttons.push_back(button);
+
+    return types.size() - 1;
 }
 
-/** Initialize a new decoration area where the edge does not matter */
-decoration_area_t::decoration_area_t(decoration_area_type_t type, wf::geometry_t g) {
-    this->type     = type;
-    this->geometry = g;
+void area_index_t::build(const area_arrays_t& areas) {
+    xs.clear();
+    slab_cells.clear();
+    cells.clear();
+
+    for (auto& g : areas.geometries) {
+        if ((g.width > 0) && (g.height > 0)) {
+            xs.push_back(g.x);
+            xs.push_back(g.x + g.width);
+        }
+    }
+    std::sort(xs.begin(), xs.end());
+    xs.erase(std::unique(xs.begin(), xs.end()), xs.end());
+
+    for (size_t s = 0; s + 1 < xs.size(); s++) {
+        slab_cells.push_back(cells.size());
+
+        /** Areas either cross a slab entirely or not at all */
+        auto crosses = [&] (const wf::geometry_t& g) {
+            return (g.width > 0) && (g.height > 0) &&
+                   (g.x <= xs[s]) && (g.x + g.width >= xs[s + 1]);
+        };
+
+        ys.clear();
+        for (auto& g : areas.geometries) {
+            if (crosses(g)) {
+                ys.push_back(g.y);
+                ys.push_back(g.y + g.height);
+            }
+        }
+        std::sort(ys.begin(), ys.end());
+        ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+
+        for (size_t c = 0; c + 1 < ys.size(); c++) {
+            cell_t cell = { ys[c], ys[c + 1], -1, 0 };
+            for (size_t i = 0; i < areas.size(); i++) {
+                auto& g = areas.geometries[i];
+                if (!crosses(g) || (g.y > cell.y1) || (g.y + g.height < cell.y2)) {
+                    continue;
+                }
+
+                if (cell.area < 0) {
+                    cell.area = i;
+                }
+                if (areas.types[i] & AREA_RESIZE_BIT) {
+                    cell.resize_edges |= (areas.types[i] & ~AREA_RESIZE_BIT);
+                }
+            }
+
+            if (cell.area < 0) {
+                continue;
+            }
+
+            /** Neighbouring cells with the same answers are merged */
+            if ((cells.size() > slab_cells.back()) && (cells.back().y2 == cell.y1) &&
+                (cells.back().area == cell.area) &&
+                (cells.back().resize_edges == cell.resize_edges)) {
+                cells.back().y2 = cell.y2;
+            } else {
+                cells.push_back(cell);
+            }
+        }
+    }
+
+    slab_cells.push_back(cells.size());
+}
+
+const area_index_t::cell_t *area_index_t::find(wf::point_t point) const {
+    auto x = std::upper_bound(xs.begin(), xs.end(), point.x);
+    if ((x == xs.begin()) || (x == xs.end())) {
+        return nullptr;
+    }
+
+    size_t s = (x - xs.begin()) - 1;
+    auto begin = cells.begin() + slab_cells[s];
+    auto end   = cells.begin() + slab_cells[s + 1];
+    auto cell  = std::upper_bound(begin, end, point.y,
+                                  [] (int y, const cell_t& cell) {
+        return y < cell.y1;
+    });
+    if ((cell == begin) || (point.y >= (cell - 1)->y2)) {
+        return nullptr;
+    }
+
+    return &*(cell - 1);
 }
 
-/** Initialize a decoration area for background areas */
-decoration_area_t::decoration_area_t(decoration_area_type_t type, wf::geometry_t g,
-                                     std::string c, matrix<int> m, edge_t edge) {
-    this->type = type;
-    this->geometry = g;
-    this->corners = c;
-    this->m = m;
-    this->edge = edge;
+decoration_area_t::decoration_area_t(decoration_layout_t *layout,
+                                     const area_arrays_t *arrays, int index) {
+    this->layout = layout;
+    this->arrays = arrays;
+    this->index  = index;
 }
 
 decoration_area_type_t decoration_area_t::get_type() const {
-    return type;
+    return arrays->types[index];
 }
 
 wf::geometry_t decoration_area_t::get_geometry() const {
-    return geometry;
+    return arrays->geometries[index];
 }
 
 wf::geometry_t decoration_area_t::get_dots_geometry() const {
-    return dots_geometry;
+    return arrays->dots_geometries[index];
 }
 
 edge_t decoration_area_t::get_edge() const {
-	return edge;
+	return arrays->edges[index];
 }
 
-std::string decoration_area_t::get_corners() const {
-    return corners;
+accent_style_t decoration_area_t::get_accent_style() const {
+    return arrays->styles[index];
 }
 
 matrix<int> decoration_area_t::get_m() const {
-    return m;
+    return arrays->transforms[index];
 }
 
-button_t& decoration_area_t::as_button() {
-    assert(button);
+button_t& decoration_area_t::as_button() const {
+    assert(arrays->buttons[index] >= 0);
 
-    return *button;
+    return layout->button_pool[arrays->buttons[index]];
 }
 
 border_size_t decoration_layout_t::parse_border(const std::string border_size_str) {
@@ -103,10 +229,70 @@ border_size_t decoration_layout_t::parse_border(const std::string border_size_st
 	}
 }
 
+std::shared_ptr<const layout_program_t> layout_program_t::get(
+    const std::string& layout, int icon_size, int button_size, int padding_size) {
+    using key_t = std::tuple<std::string, int, int, int>;
+    static std::map<key_t, std::weak_ptr<const layout_program_t>> cache;
+
+    /** Layouts no decoration uses anymore are dropped here */
+    std::erase_if(cache, [](const auto& entry) { return entry.second.expired(); });
+
+    key_t key = { layout, icon_size, button_size, padding_size };
+    if (auto it = cache.find(key); it != cache.end()) {
+        return it->second.lock();
+    }
+
+    auto program = std::make_shared<layout_program_t>();
+    std::stringstream stream(layout);
+    std::string symbol;
+
+    /** Edges missing from the string are left empty */
+    int e = 0, group = 0;
+    while ((e < 4) && (stream >> symbol)) {
+        if (symbol == "|") {
+            group = std::min(group + 1, 2);
+            continue;
+        } else if (symbol == "-") {
+            e++;
+            group = 0;
+            continue;
+        }
+
+        auto& edge = program->edges[e];
+        layout_item_t item;
+        if (symbol == "title") {
+            item.kind = LAYOUT_ITEM_TITLE;
+            edge.titles[group]++;
+        } else if (symbol == "icon") {
+            item.kind = LAYOUT_ITEM_ICON;
+            item.length = icon_size;
+        } else if (symbol == "p") {
+            item.kind = LAYOUT_ITEM_PADDING;
+            item.length = padding_size;
+        } else if (symbol[0] == 'P') {
+            item.kind = LAYOUT_ITEM_PADDING;
+            item.length = std::atoi(symbol.c_str() + 1);
+        } else if ((symbol == "a") || (symbol[0] == 'A')) {
+            item.kind = LAYOUT_ITEM_ACCENT;
+            item.style = accent_style_t::parse(symbol);
+        } else {
+            item.kind = LAYOUT_ITEM_BUTTON;
+            item.length = button_size;
+            item.button = (symbol == "minimize") ? BUTTON_MINIMIZE :
+                ((symbol == "maximize") ? BUTTON_TOGGLE_MAXIMIZE : BUTTON_CLOSE);
+        }
+
+        edge.fixed_length[group] += item.length;
+        edge.groups[group].push_back(item);
+    }
+
+    cache[key] = program;
+    return program;
+}
+
 decoration_layout_t::decoration_layout_t(const decoration_theme_t& theme,
     std::function<void(wlr_box)> callback) :
 
-	layout(theme.get_layout()),
 	border_size_str(theme.get_border_size()),
 	border_size(parse_border(border_size_str)),
 	corner_radius(theme.get_corner_radius()),
@@ -114,24 +300,16 @@ decoration_layout_t::decoration_layout_t(const decoration_theme_t& theme,
 	button_size(theme.get_button_size()),
 	icon_size(theme.get_icon_size()),
 	padding_size(theme.get_padding_size()),
+	program(layout_program_t::get(theme.get_layout(), icon_size, button_size,
+	                              padding_size)),
     theme(theme),
     damage_callback(callback)
 	{}
 
-void decoration_layout_t::create_areas(int width, int height,
-                                       wf::dimensions_t title_size,
+void decoration_layout_t::create_areas(layout_geometry_t& target, int width,
+                                       int height, wf::dimensions_t title_size,
                                        wf::dimensions_t dots_size) {
-    int count = std::count(layout.begin(), layout.end(), '-');
-    std::string layout_str = layout;
-    for (int i = 4; i > count; i--) {
-        layout_str.append(" -");
-    }
-    std::stringstream stream(layout_str);
-    std::vector<std::string> left, center, right;
-    std::string current_symbol;
-
     edge_t cur_edge = EDGE_TOP;
-    std::string current_position = "left";
     wf::point_t o = { 0, (border_size.top - max_height) / 2 };
 
 	/** The values that are used to determine the updated geometry for areas */
@@ -169,189 +347,139 @@ void decoration_layout_t::create_areas(int width, int height,
     int corner_h = std::max({ border_size.top, border_size.bottom, corner_radius });
 	/****/
 
-    while (stream >> current_symbol) {
-        if (current_symbol == "|") {
-	        current_position = (current_position == "left") ? "center" : "right";
-        } else if (current_symbol == "-") {
-        	/** Variables for background and accent definition */
-            std::string last_accent;
-        	int counter = 0;
-	        for (auto vec : { left, center, right }) {
-				if (vec != left) {
-			        int region_lenght = 0;
-
-			        for (auto type : vec) {
-				       if (type == "title")	{
-					       region_lenght += title_size.width;
-				       } else if (type == "icon") {
-					       region_lenght += icon_size;
-				       } else if (type == "p") {
-					       region_lenght += padding_size;
-				       } else if (type[0] == 'P') {
-					       int delta;
-					       std::stringstream num;
-					       num << type.substr(1);
-					       num >> delta;
-					       region_lenght += delta;
-				       } else if (type != "a" && type[0] != 'A') {
-					       region_lenght += button_size;
-				       }
-			        }
-
-					if (vec == center) {
-				        shift = (abs(trans(l).x) - region_lenght) / 2;
-					} else {
-				        shift = abs(trans(l).x) - region_lenght;
-					}
+    for (const auto& edge : program->edges) {
+    	/** Variables for background and accent definition */
+    	int counter = 0;
+        for (int group = 0; group < 3; group++) {
+			if (group > 0) {
+		        int region_lenght = edge.fixed_length[group] +
+		                            edge.titles[group] * title_size.width;
+
+				if (group == 1) {
+			        shift = (abs(trans(l).x) - region_lenght) / 2;
 				} else {
-					shift = 0;
+			        shift = abs(trans(l).x) - region_lenght;
 				}
-
-		        wf::geometry_t cur_g, cur_dots_g;
-		        for (auto type : vec) {
-			        int delta = 0;
-
-			        if (type == "title") {
-				        delta = title_size.width + dots.x;
-				        out_padding = (max_height - title_size.height) / 2;
-				        cur_g = { 
-					        o.x + trans(p()).x, o.y + trans(p()).y,
-				            trans(title).x, trans(title).y
-				        };
-				        wf::point_t dots_o = { title_size.width, 0 };
-				        dots_o = dots_o + p();
-				        cur_dots_g = {
+			} else {
+				shift = 0;
+			}
+
+	        wf::geometry_t cur_g, cur_dots_g;
+	        for (const auto& item : edge.groups[group]) {
+		        int delta = item.length;
+
+		        switch (item.kind) {
+		          case LAYOUT_ITEM_TITLE:
+                    {
+    			        delta = title_size.width + dots.x;
+    			        out_padding = (max_height - title_size.height) / 2;
+    			        cur_g = { 
+    				        o.x + trans(p()).x, o.y + trans(p()).y,
+    			            trans(title).x, trans(title).y
+    			        };
+    			        wf::point_t dots_o = { title_size.width, 0 };
+    			        dots_o = dots_o + p();
+    			        cur_dots_g = {
     				        o.x + trans(dots_o).x, o.y + trans(dots_o).y,
     				        trans(dots).x, trans(dots).y
-				        };
-
-				        layout_areas.push_back(std::make_unique<decoration_area_t>(
-						        cur_g, cur_dots_g, cur_edge));
-			        } else if (type == "icon") {
-				        delta = icon_size;
-				        out_padding = (max_height - icon_size) / 2;
-				        cur_g = {
-				        	o.x + trans(p()).x, o.y + trans(p()).y,
-				        	(m.xx + m.xy) * icon_size, (m.yx + m.yy) * icon_size
-				        };
-				        layout_areas.push_back(std::make_unique<decoration_area_t>(
-						        DECORATION_AREA_ICON, cur_g, cur_edge));
-			        } else if (type == "p") {
-				        delta = padding_size;
-			        } else if (type[0] == 'P') {
-					    std::stringstream num;
-					    num << type.substr(1);
-					    num >> delta;
-			        } else if (type == "a" || type[0] == 'A') {
-				        counter = (counter + 1) % 2;
-				        out_padding = counter * edge_height;
-				        b_p2 = { b_o.x + trans(p()).x, b_o.y + trans(p()).y };
-				        cur_g = {
+    			        };
+
+    			        target.areas.add(DECORATION_AREA_TITLE, cur_g, cur_edge,
+    			                         cur_dots_g);
+                    }
+			        break;
+		          case LAYOUT_ITEM_ICON:
+			        out_padding = (max_height - icon_size) / 2;
+			        cur_g = {
+			        	o.x + trans(p()).x, o.y + trans(p()).y,
+			        	(m.xx + m.xy) * icon_size, (m.yx + m.yy) * icon_size
+			        };
+			        target.areas.add(DECORATION_AREA_ICON, cur_g, cur_edge);
+			        break;
+		          case LAYOUT_ITEM_PADDING:
+			        break;
+		          case LAYOUT_ITEM_ACCENT:
+                    {
+    			        counter = (counter + 1) % 2;
+    			        out_padding = counter * edge_height;
+    			        b_p2 = { b_o.x + trans(p()).x, b_o.y + trans(p()).y };
+    			        cur_g = {
     				        std::min(b_p1.x, b_p2.x), std::min(b_p1.y, b_p2.y),
     				        abs(b_p2.x - b_p1.x), abs(b_p2.y - b_p1.y)
-				        };
-				        auto bg = (counter == 0) ? DECORATION_AREA_ACCENT :
-			                     DECORATION_AREA_BACKGROUND;
-	                    if (abs(cur_g.width) > 0 && abs(cur_g.height) > 0 &&
-	                        (shift > min_shift || counter == 0)) {
-    				        background_areas.push_back(
-        				        std::make_unique<decoration_area_t>(bg, cur_g, type,
-        				                                            m, cur_edge));
-	                    }
-				        b_p1 = b_p2;
-				        last_accent = type;
-			        } else {
-				        delta = button_size;
-				        out_padding = (max_height - button_size) / 2;
-				        cur_g = { 
-					       	o.x + trans(p()).x, o.y + trans(p()).y,
-					       	(m.xx + m.xy) * button_size, (m.yx + m.yy) * button_size
-				       	};
-
-				        button_type_t button = (type == "minimize") ?
-				                      BUTTON_MINIMIZE : ((type == "maximize") ?
-			        	              BUTTON_TOGGLE_MAXIMIZE : BUTTON_CLOSE);
-
-				        layout_areas.push_back(std::make_unique<decoration_area_t>(
-						        cur_g, damage_callback, theme));
-				        layout_areas.back()->as_button().set_button_type(button);
-					}			        
-
-					shift += delta;
-		        }
-	        }
+    			        };
+    			        auto bg = (counter == 0) ? DECORATION_AREA_ACCENT :
+    		                     DECORATION_AREA_BACKGROUND;
+                        if (abs(cur_g.width) > 0 && abs(cur_g.height) > 0 &&
+                            (shift > min_shift || counter == 0)) {
+    				        target.backgrounds.add(bg, cur_g, cur_edge, { 0, 0, 0, 0 },
+    				                             m, item.style);
+                        }
+    			        b_p1 = b_p2;
+                    }
+			        break;
+		          case LAYOUT_ITEM_BUTTON:
+			        out_padding = (max_height - button_size) / 2;
+			        cur_g = { 
+				       	o.x + trans(p()).x, o.y + trans(p()).y,
+				       	(m.xx + m.xy) * button_size, (m.yx + m.yy) * button_size
+			       	};
+
+                    {
+    			        int area = target.areas.add(DECORATION_AREA_BUTTON, cur_g,
+    			                                    cur_edge);
+    			        target.areas.buttons[area] = target.button_types.size();
+    			        target.button_types.push_back(item.button);
+    			        target.button_areas.push_back(area);
+                    }
+			        break;
+				}
 
-	        shift = 0;
-	        out_padding = counter * edge_height;
-	        b_p2 = { b_f.x + trans(p()).x, b_f.y + trans(p()).y };
-	        wf::geometry_t final_g = {
-		        std::min(b_p1.x, b_p2.x), std::min(b_p1.y, b_p2.y),
-		        (m.xx + m.xy) * (b_p2.x - b_p1.x), (m.yx + m.yy) * (b_p2.y - b_p1.y)
-	        };
-	        if (final_g.width > 0 && final_g.height > 0) {
-    	        auto type = DECORATION_AREA_BACKGROUND;
-    	        background_areas.push_back(
-    		        std::make_unique<decoration_area_t>(type, final_g, "", m,
-    		                                            cur_edge));
-	        }
-	        counter = 0;
-
-	        if (cur_edge == EDGE_TOP) {
-		        cur_edge = EDGE_LEFT;
-		        m = { 0, 1, -1, 0 };
-		        o = { (border_size.left - max_height) / 2,
-                      height - border_size.bottom };
-                b_o = { 0, height - border_size.bottom };
-		        b_p1 = { 0, height - corner_h };
-		        b_f = { border_size.left, corner_h };
-		        edge_height = border_size.left;
-		        min_shift = corner_radius - border_size.bottom;
-	        } else if (cur_edge == EDGE_LEFT) {
-		        cur_edge = EDGE_BOTTOM;
-		        m = { 1, 0, 0, 1 };
-		        o = b_o = { 0, height - (border_size.bottom + max_height) / 2 };
-		        b_p1 = { corner_radius, height - border_size.bottom };
-		        b_f = { width - corner_radius, height };
-		        edge_height = border_size.bottom;
-		        min_shift = corner_radius;
-	        } else {
-		        cur_edge = EDGE_RIGHT;
-		        m = { 0, -1, 1, 0 };
-		        o = { width - (border_size.right + max_height) / 2,
-		              border_size.top };
-		        b_o = { width, border_size.top };
-		        b_p1 = { width, corner_h };
-		        b_f = { width - border_size.right, height - corner_h };
-		        edge_height = border_size.right;
-		        min_shift = corner_radius - border_size.top;
+				shift += delta;
 	        }
+        }
 
-	        left.clear();
-	        center.clear();
-	        right.clear();
-	        current_position = "left";
-		        
+        shift = 0;
+        out_padding = counter * edge_height;
+        b_p2 = { b_f.x + trans(p()).x, b_f.y + trans(p()).y };
+        wf::geometry_t final_g = {
+	        std::min(b_p1.x, b_p2.x), std::min(b_p1.y, b_p2.y),
+	        (m.xx + m.xy) * (b_p2.x - b_p1.x), (m.yx + m.yy) * (b_p2.y - b_p1.y)
+        };
+        if (final_g.width > 0 && final_g.height > 0) {
+	        auto type = DECORATION_AREA_BACKGROUND;
+	        target.backgrounds.add(type, final_g, cur_edge, { 0, 0, 0, 0 }, m);
+        }
+
+        if (cur_edge == EDGE_TOP) {
+	        cur_edge = EDGE_LEFT;
+	        m = { 0, 1, -1, 0 };
+	        o = { (border_size.left - max_height) / 2,
+                  height - border_size.bottom };
+            b_o = { 0, height - border_size.bottom };
+	        b_p1 = { 0, height - corner_h };
+	        b_f = { border_size.left, corner_h };
+	        edge_height = border_size.left;
+	        min_shift = corner_radius - border_size.bottom;
+        } else if (cur_edge == EDGE_LEFT) {
+	        cur_edge = EDGE_BOTTOM;
+	        m = { 1, 0, 0, 1 };
+	        o = b_o = { 0, height - (border_size.bottom + max_height) / 2 };
+	        b_p1 = { corner_radius, height - border_size.bottom };
+	        b_f = { width - corner_radius, height };
+	        edge_height = border_size.bottom;
+	        min_shift = corner_radius;
         } else {
-	        if (current_position == "left") {
-		        left.push_back(current_symbol);
-	        } else if (current_position == "center") {
-		        center.push_back(current_symbol);
-	        } else {
-		        right.push_back(current_symbol);
-	        }
+	        cur_edge = EDGE_RIGHT;
+	        m = { 0, -1, 1, 0 };
+	        o = { width - (border_size.right + max_height) / 2,
+	              border_size.top };
+	        b_o = { width, border_size.top };
+	        b_p1 = { width, corner_h };
+	        b_f = { width - border_size.right, height - corner_h };
+	        edge_height = border_size.right;
+	        min_shift = corner_radius - border_size.top;
         }
-        
     }
-}
-
-/** Regenerate layout using a new size */
-void decoration_layout_t::resize(int width, int height, wf::dimensions_t title_size,
-                                 wf::dimensions_t dots_size) {
-    max_height = std::max({ title_size.height, icon_size, button_size });
-    this->background_areas.clear();
-    this->layout_areas.clear();
-
-    create_areas(width, height, title_size, dots_size);
 
 	/* Areas for resizing only, used for movement area calculation */
     int top_resize    = std::min(std::max(border_size.top - max_height, 7),
@@ -376,88 +504,295 @@ void decoration_layout_t::resize(int width, int height, wf::dimensions_t title_s
 	      				  std::max(border_size.right - right_resize, 0),
 	      				  height - border_size.top - border_size.bottom }
     	} ) {
-	    this->layout_areas.push_back(std::make_unique<decoration_area_t>(
-		    DECORATION_AREA_MOVE, g));
+	    target.areas.add(DECORATION_AREA_MOVE, g, EDGE_TOP);
     }
     
     /* Resizing edges - top */
     wf::geometry_t border_geometry = { 0, 0, width, top_resize };
-    this->layout_areas.push_back(std::make_unique<decoration_area_t>(
-        DECORATION_AREA_RESIZE_TOP, border_geometry, EDGE_TOP));
+    target.areas.add(DECORATION_AREA_RESIZE_TOP, border_geometry, EDGE_TOP);
 
     /* Resizing edges - left */
     border_geometry = { 0, 0, left_resize, height };
-    this->layout_areas.push_back(std::make_unique<decoration_area_t>(
-        DECORATION_AREA_RESIZE_LEFT, border_geometry, EDGE_LEFT));
+    target.areas.add(DECORATION_AREA_RESIZE_LEFT, border_geometry, EDGE_LEFT);
 
     /* Resizing edges - bottom */
     border_geometry = { 0, height - bottom_resize, width, bottom_resize };
-    this->layout_areas.push_back(std::make_unique<decoration_area_t>(
-        DECORATION_AREA_RESIZE_BOTTOM, border_geometry, EDGE_BOTTOM));
+    target.areas.add(DECORATION_AREA_RESIZE_BOTTOM, border_geometry, EDGE_BOTTOM);
 
     /* Resizing edges - right */
     border_geometry = { width - right_resize, 0, right_resize, height };
-    this->layout_areas.push_back(std::make_unique<decoration_area_t>(
-        DECORATION_AREA_RESIZE_RIGHT, border_geometry, EDGE_RIGHT));
+    target.areas.add(DECORATION_AREA_RESIZE_RIGHT, border_geometry, EDGE_RIGHT);
 }
 
-/**
- * @return The decoration areas which need to be rendered, in top to bottom
- *  order.
- */
-std::vector<nonstd::observer_ptr<decoration_area_t>> decoration_layout_t::
-get_renderable_areas() {
-    std::vector<nonstd::observer_ptr<decoration_area_t>> renderable;
-    for (auto& area : layout_areas) {
-        if (area->get_type() & AREA_RENDERABLE_BIT) {
-            renderable.push_back({area});
+std::shared_ptr<layout_geometry_t> decoration_layout_t::get_geometry(int width,
+    int height, wf::dimensions_t title_size, wf::dimensions_t dots_size) {
+    using key_t = layout_geometry_t::key_t;
+    static std::map<key_t, std::weak_ptr<layout_geometry_t>> cache;
+
+    /** Geometries no decoration uses anymore are dropped here */
+    std::erase_if(cache, [](const auto& entry) { return entry.second.expired(); });
+
+    key_t key = {
+        program.get(), border_size.top, border_size.left, border_size.bottom,
+        border_size.right, corner_radius, width, height, title_size.width,
+        title_size.height, dots_size.width, dots_size.height
+    };
+    if (auto it = cache.find(key); it != cache.end()) {
+        return it->second.lock();
+    }
+
+    std::shared_ptr<layout_geometry_t> result;
+    decltype(cache)::node_type node;
+    if (previous_geometry && (previous_geometry.use_count() == 1)) {
+        /** Nothing else can find it anymore, its entry is moved to the new key */
+        result = std::move(previous_geometry);
+        node   = cache.extract(result->key);
+        result->areas.clear();
+        result->backgrounds.clear();
+        result->button_types.clear();
+        result->button_areas.clear();
+    } else {
+        result = std::make_shared<layout_geometry_t>();
+    }
+
+    result->key = key;
+    create_areas(*result, width, height, title_size, dots_size);
+    result->index.build(result->areas);
+
+    if (node.empty()) {
+        cache[key] = result;
+    } else {
+        node.key()    = key;
+        node.mapped() = result;
+        cache.insert(std::move(node));
+    }
+
+    return result;
+}
+
+/** Regenerate layout using a new size */
+void decoration_layout_t::resize(int width, int height, wf::dimensions_t title_size,
+                                 wf::dimensions_t dots_size) {
+    max_height = std::max({ title_size.height, icon_size, button_size });
+    int hovered_button = (hovered_area >= 0) ?
+        geometry->areas.buttons[hovered_area] : -1;
+
+    /** The whole frame moves with the size, so only the same size is diffed */
+    bool resized = (size.width != width) || (size.height != height);
+    if (resized) {
+        for (const auto& box : calculate_region()) {
+            damage_callback(wlr_box_from_pixman_box(box));
         }
     }
+    this->size = { width, height };
 
-    return renderable;
+    auto last = geometry;
+    this->geometry = get_geometry(width, height, title_size, dots_size);
+
+    if (resized) {
+        for (const auto& box : calculate_region()) {
+            damage_callback(wlr_box_from_pixman_box(box));
+        }
+    } else if (last && (last != geometry)) {
+        damage_changes(last->areas, geometry->areas);
+        damage_changes(last->backgrounds, geometry->backgrounds);
+    }
+    this->previous_geometry = std::move(last);
+
+    update_buttons();
+
+    /** The input may be over another area now, without having moved */
+    if (hovered_area >= 0) {
+        this->hovered_area = find_area_at(current_input);
+        int button = (hovered_area >= 0) ? geometry->areas.buttons[hovered_area] : -1;
+        if (button != hovered_button) {
+            if ((hovered_button >= 0) &&
+                ((size_t)hovered_button < button_pool.size())) {
+                button_pool[hovered_button].set_hover(false);
+            }
+            if (button >= 0) {
+                button_pool[button].set_hover(true);
+            }
+        }
+    }
+
+    /** Kept, so rendering doesn't have to build the lists on every frame */
+    const auto& areas = geometry->areas;
+    this->renderable_view.clear();
+    for (size_t i = 0; i < areas.size(); i++) {
+        if (areas.types[i] & AREA_RENDERABLE_BIT) {
+            renderable_view.emplace_back(this, &areas, i);
+        }
+    }
+
+    this->background_view.clear();
+    for (size_t i = 0; i < geometry->backgrounds.size(); i++) {
+        background_view.emplace_back(this, &geometry->backgrounds, i);
+    }
 }
 
-std::vector<nonstd::observer_ptr<decoration_area_t>> decoration_layout_t::
-get_background_areas() {
-    std::vector<nonstd::observer_ptr<decoration_area_t>> areas;
-    for (auto& area : background_areas) {
-        areas.push_back({area});
+void decoration_layout_t::damage_changes(const area_arrays_t& previous,
+                                         const area_arrays_t& current) {
+    auto damage = [&] (const area_arrays_t& areas, size_t i) {
+        damage_callback(areas.geometries[i]);
+        if (areas.types[i] == DECORATION_AREA_TITLE) {
+            damage_callback(areas.dots_geometries[i]);
+        }
+    };
+
+    for (size_t i = 0; i < std::max(previous.size(), current.size()); i++) {
+        if ((i < previous.size()) && (i < current.size()) &&
+            previous.same_area(current, i)) {
+            continue;
+        }
+
+        /** Both where the area was, and where it is now */
+        if (i < previous.size()) {
+            damage(previous, i);
+        }
+        if (i < current.size()) {
+            damage(current, i);
+        }
     }
-    return areas;
+}
+
+void decoration_layout_t::update_buttons() {
+    const auto& types = geometry->button_types;
+    for (size_t i = 0; i < types.size(); i++) {
+        if (i < button_pool.size()) {
+            if (button_pool[i].get_button_type() != types[i]) {
+                button_pool[i].set_button_type(types[i]);
+            }
+            continue;
+        }
+
+        /** The area is damaged where it is at the time, it may have moved */
+        button_pool.emplace_back(theme, [this, i] () {
+            damage_callback(geometry->areas.geometries[geometry->button_areas[i]]);
+        });
+        button_pool.back().set_button_type(types[i]);
+    }
+
+    /** Buttons left over from a layout with more of them */
+    while (button_pool.size() > types.size()) {
+        button_pool.pop_back();
+    }
+}
+
+/**
+ * @return The decoration areas which need to be rendered, in top to bottom
+ *  order.
+ */
+const std::vector<decoration_area_t>& decoration_layout_t::get_renderable_areas() const {
+    return renderable_view;
+}
+
+const std::vector<decoration_area_t>& decoration_layout_t::get_background_areas() const {
+    return background_view;
 }
 
 wf::region_t decoration_layout_t::calculate_region() const {
+    int width  = size.width;
+    int height = size.height;
+    int inner_height = std::max(height - border_size.top - border_size.bottom, 0);
+
+    /**
+     * The square of a rounded corner that lies entirely outside of its arc.
+     * Border images are drawn into the corners as they are, so nothing is cut.
+     */
+    int cut = theme.has_border_image() ? 0 :
+        std::floor(corner_radius * (1 - M_SQRT1_2));
+    uint32_t round_on = theme.get_round_on();
+    auto cut_if = [&] (uint32_t corner) {
+        return (round_on & corner) ? cut : 0;
+    };
+
     wf::region_t r{};
-    for (auto& area : layout_areas) {
-        r |= area->get_geometry();
+    auto add = [&] (wf::geometry_t g) {
+        if ((g.width > 0) && (g.height > 0)) {
+            r |= g;
+        }
+    };
+
+    /** The top and bottom borders lose the cut squares in their outer rows */
+    int top_cut = std::min(cut, border_size.top);
+    add({ cut_if(CORNER_TL), 0, width - cut_if(CORNER_TL) - cut_if(CORNER_TR),
+          top_cut });
+    add({ 0, top_cut, width, border_size.top - top_cut });
+
+    int bottom_cut = std::min(cut, border_size.bottom);
+    add({ 0, height - border_size.bottom, width, border_size.bottom - bottom_cut });
+    add({ cut_if(CORNER_BL), height - bottom_cut,
+          width - cut_if(CORNER_BL) - cut_if(CORNER_BR), bottom_cut });
+
+    add({ 0, border_size.top, border_size.left, inner_height });
+    add({ width - border_size.right, border_size.top, border_size.right,
+          inner_height });
+
+    /**
+     * Titles, icons and buttons taller than their border stick out of it,
+     * either over the view or past the edge of the decoration.
+     */
+    if (geometry) {
+        const wf::geometry_t inner = {
+            border_size.left, border_size.top,
+            width - border_size.left - border_size.right, inner_height
+        };
+        auto sticks_out = [&] (wf::geometry_t g) {
+            bool over_view = (inner.width > 0) && (inner.height > 0) &&
+                (g.x < inner.x + inner.width) && (inner.x < g.x + g.width) &&
+                (g.y < inner.y + inner.height) && (inner.y < g.y + g.height);
+            return over_view || (g.x < 0) || (g.y < 0) ||
+                   (g.x + g.width > width) || (g.y + g.height > height);
+        };
+
+        const auto& areas = geometry->areas;
+        for (size_t i = 0; i < areas.size(); i++) {
+            if ((areas.types[i] & AREA_RENDERABLE_BIT) &&
+                sticks_out(areas.geometries[i])) {
+                add(areas.geometries[i]);
+            }
+        }
     }
 
     return r;
 }
 
-void decoration_layout_t::unset_hover(wf::point_t position) {
-    auto area = find_area_at(position);
-    if (area && (area->get_type() == DECORATION_AREA_BUTTON)) {
-        area->as_button().set_hover(false);
+button_t *decoration_layout_t::button_at(int area) {
+    if ((area < 0) || (geometry->areas.buttons[area] < 0)) {
+        return nullptr;
+    }
+
+    return &button_pool[geometry->areas.buttons[area]];
+}
+
+void decoration_layout_t::set_hovered_area(int area) {
+    if (area == hovered_area) {
+        return;
+    }
+
+    if (auto button = button_at(hovered_area)) {
+        button->set_hover(false);
+    }
+    if (auto button = button_at(area)) {
+        button->set_hover(true);
     }
+    this->hovered_area = area;
 }
 
 /** Handle motion event to (x, y) relative to the decoration */
 decoration_layout_t::action_response_t decoration_layout_t::handle_motion(
     int x, int y) {
-    auto previous_area = find_area_at(current_input);
-    auto current_area  = find_area_at({x, y});
+    int current_area = find_area_at({x, y});
 
-    if (previous_area == current_area) {
-        if (is_grabbed && current_area && (current_area->get_type() & AREA_MOVE_BIT)) {
+    if (hovered_area == current_area) {
+        if (is_grabbed && (current_area >= 0) &&
+            (geometry->areas.types[current_area] & AREA_MOVE_BIT)) {
             is_grabbed = false;
             return {DECORATION_ACTION_MOVE, 0};
         }
     } else {
-        unset_hover(current_input);
-        if (current_area && (current_area->get_type() == DECORATION_AREA_BUTTON)) {
-            current_area->as_button().set_hover(true);
-        }
+        set_hovered_area(current_area);
     }
 
     this->current_input = {x, y};
@@ -476,8 +811,9 @@ decoration_layout_t::action_response_t decoration_layout_t::handle_motion(
 decoration_layout_t::action_response_t decoration_layout_t::handle_press_event(
     bool pressed) {
     if (pressed) {
-        auto area = find_area_at(current_input);
-        if (area && (area->get_type() & AREA_MOVE_BIT)) {
+        int area  = find_area_at(current_input);
+        uint32_t type = (area >= 0) ? geometry->areas.types[area] : 0;
+        if (type & AREA_MOVE_BIT) {
             if (timer.is_connected()) {
                 double_click_at_release = true;
             } else {
@@ -485,12 +821,12 @@ decoration_layout_t::action_response_t decoration_layout_t::handle_press_event(
             }
         }
 
-        if (area && (area->get_type() & AREA_RESIZE_BIT)) {
+        if (type & AREA_RESIZE_BIT) {
             return {DECORATION_ACTION_RESIZE, calculate_resize_edges()};
         }
 
-        if (area && (area->get_type() == DECORATION_AREA_BUTTON)) {
-            area->as_button().set_pressed(true);
+        if (auto button = button_at(area)) {
+            button->set_pressed(true);
         }
 
         is_grabbed  = true;
@@ -502,13 +838,13 @@ decoration_layout_t::action_response_t decoration_layout_t::handle_press_event(
         return { DECORATION_ACTION_TOGGLE_MAXIMIZE, 0 };
     } else if (!pressed && is_grabbed) {
         is_grabbed = false;
-        auto begin_area = find_area_at(grab_origin);
-        auto end_area   = find_area_at(current_input);
+        int begin_area = find_area_at(grab_origin);
+        int end_area   = find_area_at(current_input);
 
-        if (begin_area && (begin_area->get_type() == DECORATION_AREA_BUTTON)) {
-            begin_area->as_button().set_pressed(false);
-            if (end_area && (begin_area == end_area)) {
-                switch (begin_area->as_button().get_button_type()) {
+        if (auto button = button_at(begin_area)) {
+            button->set_pressed(false);
+            if (begin_area == end_area) {
+                switch (button->get_button_type()) {
                   case BUTTON_CLOSE:
                     return { DECORATION_ACTION_CLOSE, 0 };
 
@@ -530,35 +866,29 @@ decoration_layout_t::action_response_t decoration_layout_t::handle_press_event(
 
 /**
  * Find the layout area at the given coordinates, if any
- * @return The layout area or null on failure
+ * @return The index of the layout area or -1 on failure
  */
-nonstd::observer_ptr<decoration_area_t> decoration_layout_t::find_area_at( wf::point_t point) {
-    for (auto& area : this->layout_areas) {
-        if (area->get_geometry() & point) {
-            return {area};
-        }
-    }
+int decoration_layout_t::find_area_at(wf::point_t point) const {
+    auto cell = geometry ? geometry->index.find(point) : nullptr;
 
-    return nullptr;
+    return cell ? cell->area : -1;
 }
 
 /** Calculate resize edges based on @current_input */
 uint32_t decoration_layout_t::calculate_resize_edges() const {
-    uint32_t edges = 0;
-    for (auto& area : layout_areas) {
-        if (area->get_geometry() & this->current_input) {
-            if (area->get_type() & AREA_RESIZE_BIT) {
-                edges |= (area->get_type() & ~AREA_RESIZE_BIT);
-            }
-        }
-    }
+    auto cell = geometry ? geometry->index.find(current_input) : nullptr;
 
-    return edges;
+    return cell ? cell->resize_edges : 0;
 }
 
-/** Update the cursor based on @current_input */
-void decoration_layout_t::update_cursor() const {
-    uint32_t edges   = calculate_resize_edges();
+/** Update the cursor based on @current_input, if it changed */
+void decoration_layout_t::update_cursor() {
+    uint32_t edges = calculate_resize_edges();
+    if (edges == cursor_edges) {
+        return;
+    }
+
+    this->cursor_edges = edges;
     auto cursor_name = edges > 0 ?
         wlr_xcursor_get_resize_name((wlr_edges)edges) : "default";
     wf::get_core().set_cursor(cursor_name);
@@ -567,13 +897,14 @@ void decoration_layout_t::update_cursor() const {
 void decoration_layout_t::handle_focus_lost() {
     if (is_grabbed) {
         this->is_grabbed = false;
-        auto area = find_area_at(grab_origin);
-        if (area && (area->get_type() == DECORATION_AREA_BUTTON)) {
-            area->as_button().set_pressed(false);
+        if (auto button = button_at(find_area_at(grab_origin))) {
+            button->set_pressed(false);
         }
     }
 
-    this->unset_hover(current_input);
+    this->set_hovered_area(-1);
+    /** Something else sets the cursor until the input comes back */
+    this->cursor_edges = -1;
 }
 }
 }
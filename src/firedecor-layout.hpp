@@ -1,5 +1,8 @@
 #pragma once
 
+#include <deque>
+#include <memory>
+#include <tuple>
 #include <vector>
 #include <wayfire/region.hpp>
 
@@ -30,56 +33,101 @@ enum decoration_area_type_t {
     DECORATION_AREA_ACCENT     = AREA_ACCENT_BIT,
 };
 
+/** The corners of an accent, before it is rotated onto its edge */
+enum accent_corner_t : uint8_t {
+    ACCENT_CORNER_BR  = (1 << 0),
+    ACCENT_CORNER_TR  = (1 << 1),
+    ACCENT_CORNER_TL  = (1 << 2),
+    ACCENT_CORNER_BL  = (1 << 3),
+    ACCENT_CORNER_ALL = (1 << 4) - 1,
+};
+
+/** The style of an accent's corners, parsed once from its symbol, like "Abr/" */
+struct accent_style_t {
+    /** The accent_corner_t bits of the corners to round */
+    uint8_t rounded = 0;
+    /** The accent_corner_t bits of the corners cut diagonally */
+    uint8_t diagonal = 0;
+
+    /** Parse the symbol of an accent in a layout string */
+    static accent_style_t parse(const std::string& symbol);
+};
+
 /**
- * Represents an area of the decoration which reacts to input events.
+ * The areas of a layout, as parallel arrays indexed by area, so that hit
+ * testing and rendering go through contiguous memory.
  */
-struct decoration_area_t {
-  public:
-    /**
-     * Initialize a new decoration area holding an icon.
-     * 
-     * @param type The type of the area.
-     * @param g The geometry of the area.
-     * @param edge The edge where this area is placed.
-     */
-    decoration_area_t(decoration_area_type_t type, wf::geometry_t g, edge_t edge);
+struct area_arrays_t {
+    std::vector<decoration_area_type_t> types;
+    std::vector<wf::geometry_t> geometries;
+    /** For titles only */
+    std::vector<wf::geometry_t> dots_geometries;
+    std::vector<edge_t> edges;
+    /** For backgrounds and accents only */
+    std::vector<matrix<int>> transforms;
+    std::vector<accent_style_t> styles;
+    /** For buttons only, the index of the button in the layout's pool */
+    std::vector<int> buttons;
 
-    /**
-     * Initialize a new decoration area holding a title.
-     * 
-     * @param g The geometry of the title area.
-     * @param g_dots The geometry of the dots area.
-     * @param edge The edge where this area is placed.
-     */
-    decoration_area_t(wf::geometry_t g, wf::geometry_t g_dots, edge_t edge);
+    /** @return The amount of areas */
+    size_t size() const;
 
-    /**
-     * Initialize a new decoration area holding a button.
-     *
-     * @param g The geometry of the button.
-     * @param damage_callback Callback to execute when button needs repaint.
-     * @param theme The theme to use for the button.
-     */
-    decoration_area_t(
-	    wf::geometry_t g, std::function<void(wlr_box)> damage_callback,
-	    const decoration_theme_t& theme);
+    /** Remove every area, keeping the storage for the next ones */
+    void clear();
 
-    /**
-     * Initialize a new decoration area where the edge does not matter
-     * @param type The type of the area.
-     * @param g The geometry of the area.
-     */
-    decoration_area_t(decoration_area_type_t type, wf::geometry_t g);
+    /** @return True if the area at index i is the same in both arrays */
+    bool same_area(const area_arrays_t& other, size_t i) const;
 
-    /** Initialize a new decoration area holding background areas
-     *
-     * @param g The geometry of the area.
-     * @param type The type of the area.
-     * @param c The parameters given to the area, if it is of accent type.
-     * @param m The transformation matrix
-     */
-    decoration_area_t(decoration_area_type_t type, wf::geometry_t g, std::string c,
-                      matrix<int> m, edge_t edge);
+    /** Add an area, returning its index */
+    int add(decoration_area_type_t type, wf::geometry_t g, edge_t edge,
+            wf::geometry_t dots_g = { 0, 0, 0, 0 },
+            matrix<int> m = { 1, 0, 0, 1 }, accent_style_t style = {},
+            int button = -1);
+};
+
+/**
+ * An index of the areas of a layout, answering which area is at a point in
+ * O(log n). The plane is cut into vertical slabs at every horizontal edge of an
+ * area, and each slab into cells at every vertical edge of the areas crossing
+ * it, so every cell is covered by the same areas throughout.
+ */
+struct area_index_t {
+    struct cell_t {
+        /** The vertical span of the cell, the end excluded */
+        int y1, y2;
+        /** The first area covering the cell, or -1 */
+        int area;
+        /** The edges of every resize area covering the cell */
+        uint32_t resize_edges;
+    };
+
+    /** The boundaries of the slabs, sorted */
+    std::vector<int> xs;
+    /** Where the cells of each slab begin, with the end of the last one at the end */
+    std::vector<size_t> slab_cells;
+    /** The cells of every slab, sorted by y within each slab */
+    std::vector<cell_t> cells;
+
+    /** Index the areas, keeping the storage of the last index */
+    void build(const area_arrays_t& areas);
+
+    /** @return The cell at the point, or nullptr if no area covers it */
+    const cell_t *find(wf::point_t point) const;
+
+  private:
+    /** Storage for the boundaries of a slab's cells, kept between builds */
+    std::vector<int> ys;
+};
+
+class decoration_layout_t;
+
+/**
+ * A handle to an area of a layout, valid until the layout is regenerated.
+ */
+class decoration_area_t {
+  public:
+    decoration_area_t(decoration_layout_t *layout, const area_arrays_t *arrays,
+                      int index);
 
     /** @return The type of the decoration area */
     decoration_area_type_t get_type() const;
@@ -93,33 +141,19 @@ struct decoration_area_t {
     /** @return The edge of the decoration area */
     edge_t get_edge() const;
 
-    /** @return The corners of the decoration area */
-    std::string get_corners() const;
+    /** @return The style of the corners, for accents */
+    accent_style_t get_accent_style() const;
 
     /** @return The transformation matrix of the area */
     matrix<int> get_m() const;
 
     /** @return The area's button, if the area is a button. Otherwise UB */
-    button_t& as_button();
-
-    /** This needs to be public for later appendages */
-    decoration_area_type_t type;
+    button_t& as_button() const;
 
   private:
-    wf::geometry_t geometry;
-    edge_t edge;
-
-    /** For titles only */
-    wf::geometry_t dots_geometry;
-
-    /** For buttons only */
-    std::unique_ptr<button_t> button;
-
-    /** For backgrounds and accents only */
-    std::string corners;
-
-    /** For accent corners */
-    matrix<int> m;
+    decoration_layout_t *layout;
+    const area_arrays_t *arrays;
+    int index;
 };
 
 /**
@@ -136,6 +170,75 @@ enum decoration_layout_action_t {
     DECORATION_ACTION_MINIMIZE        = 5
 };
 
+/** The kinds of items a layout string is made of */
+enum layout_item_kind_t {
+    LAYOUT_ITEM_TITLE,
+    LAYOUT_ITEM_ICON,
+    LAYOUT_ITEM_PADDING,
+    LAYOUT_ITEM_ACCENT,
+    LAYOUT_ITEM_BUTTON,
+};
+
+/** A single item of a layout string, like "title", "P5" or "minimize" */
+struct layout_item_t {
+    layout_item_kind_t kind;
+    /** How far the item shifts the ones after it, except for titles */
+    int length = 0;
+    /** For buttons only */
+    button_type_t button = BUTTON_CLOSE;
+    /** For accents only */
+    accent_style_t style;
+};
+
+/** The items of one edge, in its left, center and right groups */
+struct layout_edge_t {
+    std::vector<layout_item_t> groups[3];
+    /** The length of each group, without its titles, which depend on the view */
+    int fixed_length[3] = { 0, 0, 0 };
+    /** The amount of titles in each group */
+    int titles[3] = { 0, 0, 0 };
+};
+
+/**
+ * A layout string, compiled once into the items of each edge, so placing the
+ * areas involves no string handling. It is shared by every decoration whose
+ * theme has the same layout.
+ */
+struct layout_program_t {
+    /** The edges, in the order top, left, bottom, right */
+    layout_edge_t edges[4];
+
+    /**
+     * Get the compiled layout, compiling it only if no other decoration has it.
+     * The sizes are the ones of the theme, which the item lengths come from.
+     */
+    static std::shared_ptr<const layout_program_t> get(const std::string& layout,
+        int icon_size, int button_size, int padding_size);
+};
+
+/**
+ * The areas of a layout at one size. They only depend on the theme and on the
+ * sizes of the view and its title, so decorations of the same theme and size,
+ * like the ones of a tiled grid, share them.
+ */
+struct layout_geometry_t {
+    /** The program, border sizes, corner radius, size, title size and dots size */
+    using key_t = std::tuple<const layout_program_t*, int, int, int, int, int, int,
+                             int, int, int, int, int>;
+    key_t key;
+
+    /** The areas that take input, and the ones drawn behind them */
+    area_arrays_t areas;
+    area_arrays_t backgrounds;
+
+    /** The index of the areas, for hit testing */
+    area_index_t index;
+
+    /** The type of each button of the layout, in order, and the area it is in */
+    std::vector<button_type_t> button_types;
+    std::vector<int> button_areas;
+};
+
 struct border_size_t {
 	int top, left, bottom, right;
 
@@ -151,6 +254,8 @@ class decoration_theme_t;
  */
 class decoration_layout_t {
   public:
+    friend class decoration_area_t;
+
     /**
      * Create a new decoration layout for the given theme.
      * When the theme changes, the decoration layout needs to be created again.
@@ -166,11 +271,19 @@ class decoration_layout_t {
      */
     border_size_t parse_border(std::string border_size);
 
-    /** Create buttons in the layout, and return their total geometry */
-    void create_areas(int width, int height, wf::dimensions_t title_size,
-                      wf::dimensions_t dots_size);
+    /** Place the areas of a layout of the given size in an empty geometry */
+    void create_areas(layout_geometry_t& target, int width, int height,
+                      wf::dimensions_t title_size, wf::dimensions_t dots_size);
 
-    /** Regenerate layout using the new size */
+    /**
+     * Regenerate layout using the new size. The geometry is shared with other
+     * decorations of the same size, and only computed if none has it. The n-th
+     * button of the layout reuses the n-th button of the last layout, so buttons
+     * keep their textures and state.
+     *
+     * The new layout is compared to the last one, and only the areas that moved
+     * or changed are damaged. If the size changed, the whole frame is.
+     */
     void resize(int width, int height, wf::dimensions_t title_size,
                 wf::dimensions_t dims_size);
 
@@ -178,13 +291,17 @@ class decoration_layout_t {
      * @return The decoration areas which need to be rendered, in top to bottom
      *  order.
      */
-    std::vector<nonstd::observer_ptr<decoration_area_t>> get_renderable_areas();
+    const std::vector<decoration_area_t>& get_renderable_areas() const;
 
     /**
      * @return The background areas of the decoration */
-    std::vector<nonstd::observer_ptr<decoration_area_t>> get_background_areas();
+    const std::vector<decoration_area_t>& get_background_areas() const;
 
-    /** @return The combined region of all layout areas */
+    /**
+     * @return The region of the frame, its four borders without the parts of
+     * rounded corners that are outside of their arcs. It covers every layout
+     * area, and is computed from the sizes alone.
+     */
     wf::region_t calculate_region() const;
 
     struct action_response_t {
@@ -211,7 +328,6 @@ class decoration_layout_t {
     void handle_focus_lost();
 
   private:
-	const std::string layout;
 	const std::string border_size_str;
 	const border_size_t border_size;
 	const int corner_radius;
@@ -220,38 +336,75 @@ class decoration_layout_t {
 	const int icon_size;
 	const int padding_size;
 
+    /** The theme's layout string, compiled */
+    const std::shared_ptr<const layout_program_t> program;
+
     const decoration_theme_t& theme;
 
     int max_height;
 
+    /** The size of the layout, as of the last relayout */
+    wf::dimensions_t size = { 0, 0 };
+
     std::function<void(wlr_box)> damage_callback;
 
-    std::vector<std::unique_ptr<decoration_area_t>> layout_areas;
+    /** The geometry of the current layout, and of the one before it */
+    std::shared_ptr<layout_geometry_t> geometry;
+    std::shared_ptr<layout_geometry_t> previous_geometry;
 
-    std::vector<std::unique_ptr<decoration_area_t>> background_areas;
+    /**
+     * Get the geometry of a size, computing it only if no other decoration has
+     * it. A geometry computed here reuses the storage of the one before the
+     * last one, if no other decoration has that one.
+     */
+    std::shared_ptr<layout_geometry_t> get_geometry(int width, int height,
+        wf::dimensions_t title_size, wf::dimensions_t dots_size);
+
+    /** Damage the areas that differ between the last and the current layout */
+    void damage_changes(const area_arrays_t& previous, const area_arrays_t& current);
+
+    /**
+     * The buttons, in the order they appear in the layout. A deque, so they
+     * never move, since their callbacks refer to their position.
+     */
+    std::deque<button_t> button_pool;
+
+    /** Give every button of the geometry a button of the pool */
+    void update_buttons();
+
+    /** The areas returned by get_renderable_areas() and get_background_areas() */
+    std::vector<decoration_area_t> renderable_view;
+    std::vector<decoration_area_t> background_view;
 
     bool is_grabbed = false;
     /* Position where the grab has started */
     wf::point_t grab_origin;
     /* Last position of the input */
-    wf::point_t current_input;
+    wf::point_t current_input = { 0, 0 };
+    /** The area at @current_input, whose button is hovered if it has one */
+    int hovered_area = -1;
+    /** The resize edges of the cursor last set, or -1 if the cursor wasn't set */
+    int64_t cursor_edges = -1;
     /* double-click timer */
     wf::wl_timer timer;
     bool double_click_at_release = false;
 
     /** Calculate resize edges based on @current_input */
     uint32_t calculate_resize_edges() const;
-    /** Update the cursor based on @current_input */
-    void update_cursor() const;
+    /** Update the cursor based on @current_input, if it changed */
+    void update_cursor();
 
     /**
      * Find the layout area at the given coordinates, if any
-     * @return The layout area or null on failure
+     * @return The index of the layout area or -1 on failure
      */
-    nonstd::observer_ptr<decoration_area_t> find_area_at(wf::point_t point);
+    int find_area_at(wf::point_t point) const;
+
+    /** @return The button of the layout area, or nullptr if it has none */
+    button_t *button_at(int area);
 
-    /** Unset hover state of hovered button at @position, if any */
-    void unset_hover(wf::point_t position);
+    /** Move the hover state to the button of @area, if it has one */
+    void set_hovered_area(int area);
 };
 }
 }
@@ -0,0 +1,1134 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+
+#include <wayfire/plugins/common/cairo-util.hpp>
+
+#include "firedecor-painter.hpp"
+
+#include "cairo-simpler.hpp"
+
+#define INACTIVE 0
+#define ACTIVE 1
+
+namespace wf::firedecor {
+
+/** @return True if the two geometries share at least one pixel */
+static bool intersects(const geometry_t& a, const geometry_t& b) {
+    return (a.x < b.x + b.width) && (b.x < a.x + a.width) &&
+           (a.y < b.y + b.height) && (b.y < a.y + a.height);
+}
+
+/** @return The smallest geometry containing both geometries */
+static geometry_t bounding_box(const geometry_t& a, const geometry_t& b) {
+    int x1 = std::min(a.x, b.x), y1 = std::min(a.y, b.y);
+    int x2 = std::max(a.x + a.width, b.x + b.width);
+    int y2 = std::max(a.y + a.height, b.y + b.height);
+    return { x1, y1, x2 - x1, y2 - y1 };
+}
+
+/** @return The area of the part of the box covered by the region */
+static int64_t covered_area(const geometry_t& box, const region_t& region) {
+    int64_t area = 0;
+    for (const auto& b : region) {
+        auto in = geometry_intersection(box, wlr_box_from_pixman_box(b));
+        area += (int64_t)in.width * in.height;
+    }
+
+    return area;
+}
+
+/** Parts of the decoration's state that need to be computed again */
+enum decoration_dirty_t : uint32_t {
+    /** The title must be measured, and the areas placed again */
+    DIRTY_TITLE         = (1 << 0),
+    /** The title must be rasterized again */
+    DIRTY_TITLE_TEXTURE = (1 << 1),
+    /** The geometry of the areas or of the decoration has changed */
+    DIRTY_LAYOUT        = (1 << 2),
+    /** The colors of the decoration have changed */
+    DIRTY_COLORS        = (1 << 3),
+    /** The scale of the framebuffer has changed */
+    DIRTY_SCALE         = (1 << 4),
+    /** The view's activation or maximization has changed */
+    DIRTY_ACTIVATION    = (1 << 5),
+    /** The view's app_id has changed */
+    DIRTY_ICON          = (1 << 6),
+    DIRTY_ALL           = (1 << 7) - 1,
+};
+
+/** How long the assets of a scale are kept after no output of that scale used them */
+static constexpr std::chrono::seconds SCALE_ASSETS_TIMEOUT{10};
+
+static color_t alpha_trans(color_t c) {
+    return { c.r * c.a, c.g * c.a, c.b * c.a, c.a };
+}
+
+decoration_painter_t::scale_assets_t::~scale_assets_t() {
+    drop_own_corners();
+}
+
+void decoration_painter_t::scale_assets_t::drop_own_corners() {
+    for (int i = 0; i < 4; i++) {
+        for (auto a : { ACTIVE, INACTIVE }) {
+            own_tex[i][a].release();
+            if (own_surf[i][a]) {
+                cairo_surface_destroy(own_surf[i][a]);
+                own_surf[i][a] = nullptr;
+            }
+        }
+    }
+}
+
+decoration_painter_t::decoration_painter_t(theme_options options,
+    std::shared_ptr<decoration_renderer_t> renderer,
+    std::function<void(wlr_box)> damage_callback)
+  : dirty{DIRTY_ALL}, renderer{renderer}, theme{options},
+    layout{theme, [=, this] (wlr_box box) {
+        this->damage_box(box);
+    }}, damage_callback{damage_callback} {
+    using self_t = decoration_painter_t;
+    if (theme.get_outline_size() > 0) {
+        background_paths[0] = &self_t::render_background_areas<true, false>;
+        background_paths[1] = &self_t::render_background_areas<true, true>;
+    } else {
+        background_paths[0] = &self_t::render_background_areas<false, false>;
+        background_paths[1] = &self_t::render_background_areas<false, true>;
+    }
+}
+
+decoration_painter_t::~decoration_painter_t() {
+    for (auto& strip : strips) {
+        if (strip.surface) {
+            cairo_surface_destroy(strip.surface);
+        }
+    }
+}
+
+void decoration_painter_t::update_title(scale_assets_t& assets, double scale) {
+	dimensions_t title_size = {
+		(int)(title.dims.width * scale), (int)(title.dims.height * scale)
+    };
+	dimensions_t dots_size = {
+		(int)(title.dots_dims.width * scale),
+		(int)(title.dots_dims.height * scale)
+    };
+
+	auto o = HORIZONTAL;
+	std::string text = title.text;
+	int count = 0;
+	wf::dimensions_t size = title_size;
+
+    for (auto texture : { assets.hor, assets.ver,
+                    assets.hor_dots, assets.ver_dots }) {
+        for (auto state : { ACTIVE, INACTIVE }) {
+    		cairo_surface_t *surface;
+            surface = theme.form_title(text, size, state, o, scale);
+            texture[state].upload(surface);
+            cairo_surface_destroy(surface); 
+        }
+
+        o = (o == HORIZONTAL) ? VERTICAL : HORIZONTAL;
+        if (count == 1) { 
+            text = "...";
+            size = dots_size;
+        }
+        count++;
+    };
+    assets.title_ready = true;
+}
+
+void decoration_painter_t::update_icon() {
+    if (view_app_id != icon.app_id) {
+        icon.app_id = view_app_id;
+        for (auto& [scale, assets] : scale_assets) {
+	        assets.icon_ready = false;
+        }
+    }
+}
+
+decoration_painter_t::title_measure_t decoration_painter_t::measure_title(
+    const decoration_theme_t& theme, const std::string& view_title,
+    const std::string& view_app_id, int width, PangoContext *context) {
+    auto text_size = [&] (const std::string& text) {
+        return context ? theme.get_text_size(text, context) :
+                         theme.get_text_size(text, width);
+    };
+
+    title_measure_t measure;
+    measure.text = (theme.get_debug_mode()) ? "a" : view_title;
+
+    wf::dimensions_t cur_size = text_size(measure.text);
+
+    if (theme.get_debug_mode()) {
+        measure.text = view_app_id + " " +
+                       std::to_string(cur_size.height) + "px";
+        cur_size = text_size(measure.text);
+    }
+
+    measure.dims.height = cur_size.height;
+
+    if (cur_size.width <= theme.get_max_title_size()) {
+        measure.dims.width = cur_size.width;
+        measure.too_big = false;
+        measure.dots_dims = { 0, 0 };
+    } else {
+        wf::dimensions_t dots_size = text_size("...");
+
+        measure.dims.width = theme.get_max_title_size() - dots_size.width;
+        measure.too_big = true;
+        measure.dots_dims = dots_size;
+    }
+
+    return measure;
+}
+
+void decoration_painter_t::update_layout() {
+    apply_title(measure_title(theme, view_title, view_app_id, size.width));
+}
+
+void decoration_painter_t::apply_title(title_measure_t&& measure) {
+    title.text      = std::move(measure.text);
+    title.dims      = measure.dims;
+    title.dots_dims = measure.dots_dims;
+    title.too_big   = measure.too_big;
+
+    /** The new buttons need to know the view's state too */
+    dirty &= ~DIRTY_TITLE;
+    dirty |= DIRTY_TITLE_TEXTURE | DIRTY_LAYOUT | DIRTY_ACTIVATION;
+
+    /** Necessary in order to immediately place areas correctly */
+	layout.resize(size.width, size.height, title.dims, title.dots_dims);
+	update_opaque_region();
+}
+
+void decoration_painter_t::set_title(const std::string& title) {
+    view_title = title;
+
+    /** Before the first render, it is measured along with everything else */
+    if (dirty & DIRTY_TITLE) {
+        return;
+    }
+
+    update_layout();
+    /** The relayout damaged what moved, the text changed in place */
+    damage_areas(DECORATION_AREA_TITLE);
+}
+
+void decoration_painter_t::set_app_id(const std::string& app_id) {
+    view_app_id = app_id;
+    dirty |= DIRTY_ICON;
+}
+
+void decoration_painter_t::set_view_state(bool activated, uint32_t tiled_edges) {
+    this->activated   = activated;
+    this->tiled_edges = tiled_edges;
+    dirty |= DIRTY_ACTIVATION;
+}
+
+decoration_painter_t::scale_assets_t& decoration_painter_t::get_assets(double scale) {
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = scale_assets.begin(); it != scale_assets.end();) {
+        if ((it->first == scale) ||
+            (now - it->second.last_used < SCALE_ASSETS_TIMEOUT)) {
+            ++it;
+            continue;
+        }
+
+        for (auto item : layout.get_renderable_areas()) {
+            if (item.get_type() == DECORATION_AREA_BUTTON) {
+                item.as_button().drop_scale(it->first);
+            }
+        }
+        it = scale_assets.erase(it);
+    }
+
+    auto& assets = scale_assets[scale];
+    assets.last_used = now;
+
+    if (!assets.title_ready) {
+        update_title(assets, scale);
+    }
+
+    if (!assets.icon_ready) {
+        auto surface = theme.form_icon(icon.app_id, scale);
+        assets.icon.upload(surface);
+        cairo_surface_destroy(surface);
+        assets.icon_ready = true;
+    }
+
+    if (!assets.corners_ready) {
+        assets.drop_own_corners();
+        assets.accents.clear();
+        int i = 0;
+        for (auto *c : { &corners.tr, &corners.tl, &corners.bl, &corners.br }) {
+            assets.corners[i++] = theme.get_corner(c->r, corner_height, scale);
+        }
+        assets.border_image = theme.get_border_image(scale);
+        assets.corners_ready = true;
+    }
+
+    return assets;
+}
+
+void decoration_painter_t::update_opaque_region() {
+    for (auto state : { ACTIVE, INACTIVE }) {
+        opaque_region[state].clear();
+    }
+
+    if (fullscreen) {
+        return;
+    }
+
+    auto opaque = [](color_t c) { return c.a >= 1.0; };
+    if (simplified) {
+        auto border = theme.get_border_colors();
+        for (auto state : { ACTIVE, INACTIVE }) {
+            if (opaque((state == ACTIVE) ? border.active : border.inactive)) {
+                opaque_region[state] = cached_region;
+            }
+        }
+
+        return;
+    }
+
+    /** Nothing is known about the pixels of border images */
+    if (theme.has_border_image()) {
+        return;
+    }
+
+    int o_s = theme.get_outline_size();
+
+    for (auto state : { ACTIVE, INACTIVE }) {
+        color_t border  = (state == ACTIVE) ? theme.get_border_colors().active :
+                          theme.get_border_colors().inactive;
+        color_t outline = (state == ACTIVE) ? theme.get_outline_colors().active :
+                          theme.get_outline_colors().inactive;
+        color_t accent  = (state == ACTIVE) ? theme.get_accent_colors().active :
+                          theme.get_accent_colors().inactive;
+
+        for (auto area : layout.get_background_areas()) {
+            geometry_t g = area.get_geometry();
+            if (area.get_type() == DECORATION_AREA_ACCENT) {
+                if (!opaque(accent)) { continue; }
+
+                /** Same radius as the one used in form_accent_corners */
+                int r = std::min({ (int)ceil((double)g.height / 2),
+                                   (int)ceil((double)g.width / 2),
+                                   theme.get_corner_radius() });
+                if (area.get_m().xy == 0) {
+                    g = { g.x + r, g.y, g.width - 2 * r, g.height };
+                } else {
+                    g = { g.x, g.y + r, g.width, g.height - 2 * r };
+                }
+            } else if (!opaque(border) || (o_s > 0 && !opaque(outline))) {
+                continue;
+            }
+
+            if (g.width > 0 && g.height > 0) {
+                opaque_region[state] |= g;
+            }
+        }
+    }
+}
+
+void decoration_painter_t::make_own_corner(scale_assets_t& assets, int index, int active) {
+    if (assets.own_surf[index][active]) {
+        return;
+    }
+
+    const corner_texture_t *all[4] = {
+        &corners.tr, &corners.tl, &corners.bl, &corners.br
+    };
+    const auto& c = *all[index];
+    auto *src = assets.corners[index]->surf[active];
+    int width  = cairo_image_surface_get_width(src);
+    int height = cairo_image_surface_get_height(src);
+    bool flip_x = c.bits & OpenGL::TEXTURE_TRANSFORM_INVERT_X;
+    bool flip_y = c.bits & OpenGL::TEXTURE_TRANSFORM_INVERT_Y;
+
+    auto *&own = assets.own_surf[index][active];
+    own = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+    auto cr = cairo_create(own);
+    cairo_translate(cr, flip_x ? width : 0, flip_y ? height : 0);
+    cairo_scale(cr, flip_x ? -1 : 1, flip_y ? -1 : 1);
+    cairo_set_source_surface(cr, src, 0, 0);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+}
+
+void decoration_painter_t::update_corners() {
+	corner_radius = theme.get_corner_radius();
+	uint32_t round_on = theme.get_round_on();
+	corners.tr.r = (round_on & CORNER_TR) ? corner_radius : 0;
+	corners.tl.r = (round_on & CORNER_TL) ? corner_radius : 0;
+	corners.bl.r = (round_on & CORNER_BL) ? corner_radius : 0;
+	corners.br.r = (round_on & CORNER_BR) ? corner_radius : 0;
+
+	corner_height = std::max( { corner_radius, border_size.top,
+	                            border_size.bottom });
+	auto use_image = [&](corner_texture_t& t, uint32_t bits) {
+		t.bits = bits;
+	};
+	/** The flips are how we get 4 different corners out of one */
+	using namespace OpenGL;
+	use_image(corners.tr, 0);
+	use_image(corners.tl, TEXTURE_TRANSFORM_INVERT_X);
+	use_image(corners.bl, TEXTURE_TRANSFORM_INVERT_X |
+	                      TEXTURE_TRANSFORM_INVERT_Y);
+	use_image(corners.br, TEXTURE_TRANSFORM_INVERT_Y);
+
+	for (auto& [scale, assets] : scale_assets) {
+		assets.corners_ready = false;
+	}
+}
+
+void decoration_painter_t::update_render_state(double scale) {
+    if (scale != state.scale) {
+        state.scale = scale;
+        dirty |= DIRTY_SCALE;
+    }
+
+    if (dirty) {
+        composite_damage |= geometry_t{ 0, 0, size.width, size.height };
+    }
+
+    if (dirty & DIRTY_TITLE) {
+        update_layout();
+    }
+
+    if (dirty & DIRTY_TITLE_TEXTURE) {
+        for (auto& [scale, assets] : scale_assets) {
+            assets.title_ready = false;
+        }
+    }
+
+    if (dirty & DIRTY_ICON) {
+        update_icon();
+    }
+
+    if (dirty & DIRTY_COLORS) {
+        auto border  = theme.get_border_colors();
+        auto outline = theme.get_outline_colors();
+        auto accent  = theme.get_accent_colors();
+        state.border[ACTIVE]    = alpha_trans(border.active);
+        state.border[INACTIVE]  = alpha_trans(border.inactive);
+        state.outline[ACTIVE]   = alpha_trans(outline.active);
+        state.outline[INACTIVE] = alpha_trans(outline.inactive);
+        state.accent[ACTIVE]    = alpha_trans(accent.active);
+        state.accent[INACTIVE]  = alpha_trans(accent.inactive);
+    }
+
+    if (dirty & DIRTY_COLORS) {
+        update_corners();
+    }
+
+    if (dirty & (DIRTY_COLORS | DIRTY_SCALE | DIRTY_LAYOUT)) {
+        int h = std::max({ corner_radius, border_size.top, border_size.bottom });
+        corners.tr.g = { size.width - corner_radius, 0, corner_radius, h };
+        corners.tl.g = { 0, 0, corner_radius, h };
+        corners.bl.g = { 0, size.height - h, corner_radius, h };
+        corners.br.g = { size.width - corner_radius, size.height - h,
+                         corner_radius, h };
+    }
+
+    if (dirty & DIRTY_ACTIVATION) {
+        for (auto item : layout.get_renderable_areas()) {
+            if (item.get_type() == DECORATION_AREA_BUTTON) {
+	            item.as_button().set_active(activated);
+	            item.as_button().set_maximized(tiled_edges);
+            }
+        }
+    }
+
+    dirty = 0;
+}
+
+void decoration_painter_t::render_title(const render_target_t& fb, geometry_t geometry,
+                                        geometry_t dots_geometry, edge_t edge,
+                                        geometry_t scissor) {
+    atlas_texture_t *texture, *dots_texture;
+    uint32_t bits = 0;
+    if (edge == EDGE_TOP || edge == EDGE_BOTTOM) {
+        bits = OpenGL::TEXTURE_TRANSFORM_INVERT_Y;
+        texture = &current_assets->hor[activated];
+        dots_texture = &current_assets->hor_dots[activated];
+    } else {
+	    texture = &current_assets->ver[activated];
+        dots_texture = &current_assets->ver_dots[activated];
+    }
+
+    renderer->add_texture(LAYER_CONTENT, *texture, geometry, bits);
+    if (title.too_big) {
+        renderer->add_texture(LAYER_CONTENT, *dots_texture, dots_geometry, bits);
+    }
+}
+
+void decoration_painter_t::render_icon(geometry_t g, int32_t bits) {
+    renderer->add_texture(LAYER_CONTENT, current_assets->icon, g, bits);
+}
+
+void decoration_painter_t::form_accent_corners(scale_assets_t& assets, double scale, int r,
+                                               geometry_t accent, accent_style_t style,
+                                               matrix<int> m, edge_t edge) {
+    const auto format = CAIRO_FORMAT_ARGB32;
+    cairo_surface_t *surfaces[4];
+    double angle = 0;
+
+    /** Colors of the accent and background, respectively */
+    color_t a_color;
+    color_t b_color;
+
+    wf::point_t a_origin = { accent.x, accent.y };
+
+    int h = std::max({ corner_radius, border_size.top, border_size.bottom });
+
+    wf::geometry_t a_edges[2];
+    if (m.xx == 1) {
+        a_edges[0] = { 0, 0, r, accent.height };
+        a_edges[1] = { accent.width - r, 0, r, accent.height };
+    } else {
+        a_edges[0] = { 0, 0, accent.width, r };
+        a_edges[1] = { 0, accent.height - r, accent.width, r };
+    }
+
+    wf::geometry_t cut;
+    if (m.xy == 0) { 
+        cut = { accent.x + r, accent.y, accent.width - 2 * r, accent.height };
+    } else {
+        cut = { accent.x, accent.y + r, accent.width, accent.height - 2 * r };
+    }
+
+    /**** Creation of the master path, containing all accent edge textures */
+    const cairo_matrix_t matrix = {
+        (double)m.xx, (double)m.xy, (double)m.yx, (double)m.yy, 0, 0
+    };
+
+    /** Array used to determine if a line starts on the corner or not */
+    struct { int tr = 0, br = 0, bl = 0, tl = 0; } retract;
+
+    /** Calculate where to retract, based on diagonality */
+    retract.tl = (style.diagonal & ACCENT_CORNER_TL) ? r : 0;
+    retract.br = (style.diagonal & ACCENT_CORNER_BR) ? r : 0;
+    retract.bl = (style.diagonal & ACCENT_CORNER_BL) ? r : 0;
+    retract.tr = (style.diagonal & ACCENT_CORNER_TR) ? r : 0;
+
+    /** "Untransformed" accent area, used for correct transformations later on */
+    const wf::dimensions_t mod_a = {
+        abs(accent.width * m.xx + accent.height * m.xy),
+        abs(accent.width * m.yx + accent.height * m.yy)
+    };
+
+    auto full_surface = cairo_image_surface_create(format, accent.width,
+                                                   accent.height);
+    auto cr = cairo_create(full_surface);
+
+    /** The accent_corner_t bits of the final corners to round */
+    uint8_t to_round = 0;
+
+    /** True mathematical modulo */
+    auto modulo = [](int a, int b) -> int {
+       return a - b * floor((double)a / b);
+    };
+
+    /** Deciding which corners to round, based on the style and on rotation */
+    for (int c = 0; c < 4; c++) {
+        if (style.rounded & (1 << c)) {
+            /**
+             * This effectively rotates the chosen corner.
+             * When m.xy == 1 (left edge), br becomes tr, tr becomes tl, etc.
+             * On the right edge, the opposite happens.
+             * This is to keep the correct corners rounded for the end user.
+             */
+            to_round |= (1 << modulo(c - m.xy, 4));
+            if (modulo(c - m.xy, 4) == 0) { retract.br = r; }
+        }
+    }
+
+    /** Point of rotation, in case it is needed */
+    int rotation_x_d = ((m.xy == 1) ? mod_a.height : mod_a.width ) / 2;
+    wf::point_t rotation_point = { rotation_x_d, rotation_x_d };
+
+    /** Rotation depending on the edge */
+    cairo_translate(cr, rotation_point);
+    cairo_transform(cr, &matrix);
+    cairo_translate(cr, -rotation_point);
+
+    /** Lambda that creates a rounded or flat corner */
+    auto create_corner = [&](int w, int h, int i) {
+        if (to_round & (1 << i)) {
+            cairo_arc(cr, w + ((i < 2) ? -r : r), h + ((i % 3 == 0) ? r : -r), r,
+                      M_PI_2 * (i - 1), M_PI_2 * i);
+        } else {
+            if (i % 2 == 0) { cairo_line_to(cr, w, h); }
+            cairo_line_to(cr, w, h + ((i == 0) ? r : ((i == 2) ? -r : 0)));
+        }
+    };
+
+    cairo_move_to(cr, mod_a.width - retract.br, 0);
+    if (!(to_round & (ACCENT_CORNER_BR | ACCENT_CORNER_TR))) {
+        cairo_line_to(cr, mod_a.width - retract.tr, mod_a.height);
+    } else {
+        create_corner(mod_a.width, 0, 0);
+        create_corner(mod_a.width, mod_a.height, 1);
+    }
+    if (!(to_round & (ACCENT_CORNER_TL | ACCENT_CORNER_BL))) {
+        cairo_line_to(cr, retract.tl, mod_a.height);
+        cairo_line_to(cr, retract.bl, 0);
+    } else {
+        create_corner(0, mod_a.height, 2);
+        create_corner(0, 0, 3);
+    }
+    cairo_close_path(cr);
+    auto master_path = cairo_copy_path(cr);
+    cairo_destroy(cr);
+    cairo_surface_destroy(full_surface);
+    /****/
+    
+    for (int i = 0, j = 0; i < 4; i++, angle += M_PI / 2, j = i % 2) {
+        if (i < 2) {
+            a_color = theme.get_accent_colors().inactive;
+            b_color = theme.get_border_colors().inactive;
+        } else {
+            a_color = theme.get_accent_colors().active;
+            b_color = theme.get_border_colors().active;
+        }
+        int width = std::ceil(a_edges[j].width * scale);
+        int height = std::ceil(a_edges[j].height * scale);
+            
+        surfaces[i] = cairo_image_surface_create(format, width, height);
+        auto cr_a = cairo_create(surfaces[i]);
+        cairo_scale(cr_a, scale, scale);
+
+        /** Background rectangle, behind the accent's corner */
+        cairo_set_source_rgba(cr_a, b_color);
+        cairo_rectangle(cr_a, 0, 0, a_edges[j].width, a_edges[j].height);
+        cairo_fill(cr_a);
+
+        /**** Outline, done early so it can also be cropped off */
+        /** Translation to the correct rotation */
+        cairo_translate(cr_a , rotation_point); 
+        cairo_transform(cr_a , &matrix);
+        cairo_translate(cr_a , -rotation_point); 
+
+        int o_size = theme.get_outline_size();
+        auto outline_color = state.outline[activated];
+
+
+        /** Draw outline on the bottom in case it is in the bottom edge */
+        int h_offset = (edge == EDGE_BOTTOM) ? mod_a.height : o_size;
+
+        cairo_set_source_rgba(cr_a, outline_color);
+        cairo_rectangle(cr_a, 0, mod_a.height - h_offset, mod_a.width, o_size);
+        cairo_fill(cr_a);
+        /****/
+
+        /** Dealing with intersection between the view's corners and accent */
+        int index = -1;
+        for (auto *c : { &corners.tr, &corners.tl, &corners.bl, &corners.br } ) {
+            index++;
+
+            /** Accent edge translated by the accent's origin */
+            wf::geometry_t a_edge = a_edges[j] + a_origin;
+
+            /** Skip everything if the areas don't intersect */
+            auto in = geometry_intersection(a_edge, c->g);
+            if (in.width == 0 || in.height == 0) { continue; }
+
+            /**** Rectangle to cut the background from the accent's corner */
+            /** View's corner position relative to the accent's corner */
+            point_t v_rel_a = { 
+                c->g.x - a_edge.x, c->g.y - a_edge.y
+            };
+
+            cairo_set_operator(cr_a, CAIRO_OPERATOR_CLEAR);
+            cairo_rectangle(cr_a, v_rel_a, corner_radius, h);
+            cairo_fill(cr_a);
+            /****/
+
+            /** Removal of intersecting areas from the view corner */
+            for (auto active : { ACTIVE, INACTIVE }) {
+
+                /**** Removing the edges with cut, flat, or diagonal corners */
+                /** Surface to remove from, the view corner in this case */
+                make_own_corner(assets, index, active);
+                auto *own = assets.own_surf[index][active];
+                auto cr_v = cairo_create(own);
+                cairo_scale(cr_v, scale, scale);
+                cairo_set_operator(cr_v, CAIRO_OPERATOR_CLEAR);
+
+                /** Transformed br accent corner, relative to the view corner */
+                wf::point_t t_br_rel_v = {
+                    (a_origin.x) - c->g.x,
+                    (c->g.y + c->g.height) - (a_origin.y + accent.height)
+                };
+
+                cairo_translate(cr_v, t_br_rel_v.x, t_br_rel_v.y);
+
+                cairo_translate(cr_v , rotation_point); 
+                cairo_transform(cr_v , &matrix);
+                cairo_translate(cr_v , -rotation_point); 
+
+                cairo_append_path(cr_v, master_path);
+                cairo_fill(cr);
+                /****/
+
+                /**** Clear the view's corner with the accent rectangles */
+                /** Bottom of the rectangle relative to the view's corner */
+                wf::point_t reb_rel_v;
+                reb_rel_v.y = (c->g.y + c->g.height) - (cut.y + cut.height);
+                reb_rel_v.x = (cut.x - c->g.x);
+
+                cairo_set_operator(cr_v, CAIRO_OPERATOR_CLEAR);
+                cairo_rectangle(cr_v, reb_rel_v, cut.width, cut.height);
+                cairo_fill(cr_v);
+                /****/
+                        
+                assets.own_tex[index][active].upload(own);
+                cairo_destroy(cr_v);
+            }
+        }
+
+        /**** Final drawing of accent corner, overlaying the drawn rectangle */
+        cairo_set_operator(cr_a, CAIRO_OPERATOR_SOURCE);
+
+        wf::point_t t_br = {
+            (r - mod_a.width) * (m.xx * (i % 2) + m.xy * (1 - i % 2)), 0
+        };
+
+        cairo_set_source_rgba(cr_a, a_color);
+        cairo_translate(cr_a, t_br.x, t_br.y);
+        cairo_append_path(cr_a, master_path);
+        cairo_fill(cr_a);
+        cairo_destroy(cr_a);
+        /****/
+    }
+    auto& texture = assets.accents.back();
+    texture.t_trbr[INACTIVE].upload(surfaces[0]);
+    texture.t_tlbl[INACTIVE].upload(surfaces[1]);
+    texture.t_trbr[ACTIVE].upload(surfaces[2]);
+    texture.t_tlbl[ACTIVE].upload(surfaces[3]);
+    texture.radius = r;
+
+    for (auto surface : surfaces) { cairo_surface_destroy(surface); }
+    cairo_path_destroy(master_path);
+}
+
+void decoration_painter_t::render_accent(geometry_t g, point_t o, const geometry_t& scissor,
+                                         accent_style_t style, unsigned long i,
+                                         matrix<int> m, edge_t edge) {
+    /**** Render the corners of an accent */
+    int r;
+
+    /** Create the corners, it should happen once per accent and scale */
+    auto& accents = current_assets->accents;
+    if (accents.size() <= i) {
+        accents.resize(i + 1);
+        r = std::min({ ceil((double)g.height / 2), ceil((double)g.width / 2),
+                       (double)corner_radius});
+        /** Flat accents need no textures at all */
+        if (theme.get_quality() == QUALITY_FAST) {
+            accents.back().radius = 0;
+        } else {
+            form_accent_corners(*current_assets, current_scale, r, g, style,
+                                m, edge);
+        }
+    }
+
+    r = accents.at(i).radius;
+
+    /** The textures above must exist, even if the accent isn't drawn now */
+    if (!intersects(g + o, scissor)) { return; }
+
+    geometry_t a_edges[2];
+    if (m.xx == 1) {
+        a_edges[0] = { g.x, g.y, r, g.height };
+        a_edges[1] = { g.x + g.width - r, g.y, r, g.height };
+    } else {
+        a_edges[0] = { g.x, g.y, g.width, r };
+        a_edges[1] = { g.x, g.y + g.height - r, g.width, r };
+    }
+
+    renderer->add_texture(LAYER_EDGES,
+                          accents.at(i).t_trbr[activated],
+                          a_edges[0] + o);
+    renderer->add_texture(LAYER_EDGES,
+                          accents.at(i).t_tlbl[activated],
+                          a_edges[1] + o);
+    /****/
+
+    /**** Render the internal rectangles of the accent */
+    wf::geometry_t accent_rect;
+    if (m.xy == 0) {
+        accent_rect = { g.x + r, g.y, g.width - 2 * r, g.height };
+    } else {
+        accent_rect = { g.x, g.y + r, g.width, g.height - 2 * r };
+    }
+
+    color_t color = state.accent[activated];
+    renderer->add_rectangle(LAYER_BACKGROUND, accent_rect + o, color);
+    /****/
+}
+
+/** Where the outline of an area lies, on each axis, 1 if it does */
+struct outline_side_t {
+    /** The outline runs along the whole area */
+    int along_x, along_y;
+    /** The outline is on the far side of the area, or on its near side */
+    int far_x, far_y, near_x, near_y;
+};
+
+/** The sides of the outline, in the order of edge_t */
+static constexpr outline_side_t outline_sides[4] = {
+    /* top */    { 1, 0, 0, 0, 0, 1 },
+    /* left */   { 0, 1, 0, 0, 1, 0 },
+    /* bottom */ { 1, 0, 0, 1, 0, 0 },
+    /* right */  { 0, 1, 1, 0, 0, 0 },
+};
+
+template<bool OUTLINE>
+void decoration_painter_t::render_border_area(geometry_t g, point_t o, const geometry_t& scissor,
+                                              edge_t edge) {
+    if (!intersects(g + o, scissor)) { return; }
+
+    if constexpr (!OUTLINE) {
+        renderer->add_rectangle(LAYER_BACKGROUND, g + o,
+                                state.border[activated]);
+    } else {
+        /** The outline is split off the outer side of the area, by its edge */
+        const auto& side = outline_sides[edge];
+        int o_s = theme.get_outline_size();
+        int across_x = (1 - side.along_x) * o_s, across_y = (1 - side.along_y) * o_s;
+        wf::geometry_t g_o = {
+            g.x + side.far_x * (g.width - o_s), g.y + side.far_y * (g.height - o_s),
+            side.along_x * g.width + across_x, side.along_y * g.height + across_y
+        };
+        g = { g.x + side.near_x * o_s, g.y + side.near_y * o_s,
+              g.width - across_x, g.height - across_y };
+
+        renderer->add_rectangle(LAYER_BACKGROUND, g + o,
+                                state.border[activated]);
+        renderer->add_rectangle(LAYER_BACKGROUND, g_o + o,
+                                state.outline[activated]);
+    }
+}
+
+template<bool OUTLINE, bool BORDER_IMAGE>
+void decoration_painter_t::render_background_areas(point_t o, const geometry_t& scissor) {
+    unsigned long i = 0;
+    for (const auto& area : layout.get_background_areas()) {
+        if (area.get_type() == DECORATION_AREA_ACCENT) {
+            render_accent(area.get_geometry(), o, scissor,
+                          area.get_accent_style(), i, area.get_m(),
+                          area.get_edge());
+        } else if constexpr (!BORDER_IMAGE) {
+            /** The border image replaces the borders and outlines */
+            render_border_area<OUTLINE>(area.get_geometry(), o, scissor,
+                                        area.get_edge());
+        }
+        i++;
+    }
+}
+
+void decoration_painter_t::render_background(const render_target_t& fb, geometry_t rect,
+                                             const geometry_t& scissor) {
+	/** The border image replaces the borders, outlines and corners */
+	auto& border_image = current_assets->border_image;
+	if (border_image) {
+		renderer->add_nine_slice(LAYER_FRAME, border_image->tex, rect,
+		                         border_image->slice,
+		                         { border_size.top, border_size.left,
+		                           border_size.bottom, border_size.right },
+		                         false);
+	}
+
+	/** Borders */
+	point_t rect_o = { rect.x, rect.y };
+	(this->*background_paths[border_image != nullptr])(rect_o, scissor);
+
+	if (border_image) {
+		return;
+	}
+
+	/** Outlines */
+    bool a = activated;
+    point_t o = { rect.x, rect.y };
+	/** Rendering all corners */
+	int i_c = 0;
+	for (auto *c : { &corners.tr, &corners.tl, &corners.bl, &corners.br }) {
+		int index = i_c++;
+		auto& image = current_assets->corners[index];
+		if (!intersects(c->g + o, scissor)) { continue; }
+		if (current_assets->own_surf[index][a]) {
+    		renderer->add_texture(LAYER_EDGES, current_assets->own_tex[index][a],
+    		                      c->g + o);
+		} else {
+    		renderer->add_texture(LAYER_EDGES, image->tex[a], c->g + o,
+    		                      c->bits);
+		}
+	}
+}
+
+void decoration_painter_t::render_scissor_box(const render_target_t& fb, point_t origin,
+                                              const wlr_box& scissor) {
+    renderer->begin(fb, scissor);
+    record_scissor_box(fb, origin, scissor);
+    renderer->end();
+}
+
+void decoration_painter_t::record_scissor_box(const render_target_t& fb, point_t origin,
+                                              const wlr_box& scissor) {
+    /** Too small to make out any detail, so no asset is drawn at all */
+    if (simplified) {
+        color_t color = state.border[activated];
+        for (const auto& box : cached_region) {
+            geometry_t g = wlr_box_from_pixman_box(box) + origin;
+            if (intersects(g, scissor)) {
+                renderer->add_rectangle(LAYER_BACKGROUND, g, color);
+            }
+        }
+
+        return;
+    }
+
+    /** Draw the background (corners and border) */
+    wlr_box geometry{origin.x, origin.y, size.width, size.height};
+    render_background(fb, geometry, scissor);
+
+    for (auto item : layout.get_renderable_areas()) {
+        int32_t bits = 0;
+        if (item.get_edge() == EDGE_LEFT) {
+            bits = OpenGL::TEXTURE_TRANSFORM_INVERT_Y; 
+        } else if (item.get_edge() == EDGE_RIGHT) {
+            bits = OpenGL::TEXTURE_TRANSFORM_INVERT_X;
+        }
+        geometry_t g = item.get_geometry() + origin;
+        if (item.get_type() == DECORATION_AREA_TITLE) {
+	        geometry_t dots_g = item.get_dots_geometry() + origin;
+	        if (intersects(g, scissor) ||
+	            (title.too_big && intersects(dots_g, scissor))) {
+                render_title(fb, g, dots_g, item.get_edge(), scissor);
+	        }
+        } else if (item.get_type() == DECORATION_AREA_BUTTON) {
+            if (intersects(g, scissor)) {
+                item.as_button().render(*renderer, g, current_scale);
+            }
+        } else if (item.get_type() == DECORATION_AREA_ICON) {
+            if (intersects(g, scissor)) {
+	            render_icon(g, bits);
+            }
+        }
+    }
+}
+
+void decoration_painter_t::update_strips(const render_target_t& fb) {
+    double scale = fb.scale;
+    int top = std::max({ border_size.top, corners.tl.g.height,
+                         corners.tr.g.height });
+    int bottom = std::max({ border_size.bottom, corners.bl.g.height,
+                            corners.br.g.height });
+    int middle = size.height - top - bottom;
+    geometry_t boxes[4] = {
+        { 0, 0, size.width, top },
+        { 0, size.height - bottom, size.width, bottom },
+        { 0, top, border_size.left, middle },
+        { size.width - border_size.right, top, border_size.right, middle },
+    };
+
+    for (int i = 0; i < 4; i++) {
+        auto& strip = strips[i];
+        geometry_t g = boxes[i];
+        if ((g.width <= 0) || (g.height <= 0)) {
+            strip.tex.release();
+            continue;
+        }
+
+        int width  = std::ceil(g.width * scale);
+        int height = std::ceil(g.height * scale);
+        bool resized = !strip.surface || (strip.g != g) ||
+            (cairo_image_surface_get_width(strip.surface) != width) ||
+            (cairo_image_surface_get_height(strip.surface) != height);
+        if (resized) {
+            if (strip.surface) {
+                cairo_surface_destroy(strip.surface);
+            }
+            strip.surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                                       width, height);
+            strip.g = g;
+        }
+
+        region_t damage = resized ? region_t{g} : (composite_damage & g);
+        if (damage.empty()) {
+            continue;
+        }
+
+        renderer->begin_composite(strip.surface, { g.x, g.y }, scale);
+        record_scissor_box(fb, { 0, 0 }, damage.get_extents());
+        renderer->end_composite(damage);
+        strip.tex.upload(strip.surface);
+    }
+
+    composite_damage.clear();
+}
+
+void decoration_painter_t::render(const render_target_t& fb, point_t origin,
+                                  const region_t& damage) {
+    current_scale = fb.scale * lod;
+    update_render_state(current_scale);
+    if (!simplified) {
+        current_assets = &get_assets(current_scale);
+    }
+    if (renderer->is_software()) {
+        update_strips(fb);
+    }
+
+    /**
+     * Coalesce the damaged boxes. Two boxes are merged when every part of the
+     * decoration inside their bounding box is damaged anyway, since then one
+     * pass over the merged box draws exactly the same pixels as two passes.
+     *
+     * This runs on every frame, so it works on the boxes themselves, and
+     * the regions are never combined into new ones, which would allocate.
+     */
+    point_t o = origin;
+    auto fully_damaged = [&] (const geometry_t& merged) {
+        for (const auto& c : cached_region) {
+            auto part = geometry_intersection(wlr_box_from_pixman_box(c) + o,
+                                              merged);
+            int64_t area = (int64_t)part.width * part.height;
+            if ((area > 0) && (covered_area(part, damage) != area)) {
+                return false;
+            }
+        }
+
+        return true;
+    };
+
+    scissor_boxes.clear();
+    for (const auto& d : damage) {
+        for (const auto& c : cached_region) {
+            geometry_t b = geometry_intersection(wlr_box_from_pixman_box(d),
+                                                 wlr_box_from_pixman_box(c) + o);
+            if ((b.width <= 0) || (b.height <= 0)) {
+                continue;
+            }
+
+            if (!scissor_boxes.empty()) {
+                geometry_t merged = bounding_box(scissor_boxes.back(), b);
+                if (fully_damaged(merged)) {
+                    scissor_boxes.back() = merged;
+                    continue;
+                }
+            }
+            scissor_boxes.push_back(b);
+        }
+    }
+
+    for (const auto& box : scissor_boxes) {
+        if (!renderer->is_software()) {
+            render_scissor_box(fb, origin, box);
+            continue;
+        }
+
+        /** The strips are upright, like the cairo surfaces of titles */
+        renderer->begin(fb, box);
+        for (auto& strip : strips) {
+            renderer->add_texture(LAYER_CONTENT, strip.tex,
+                                  strip.g + origin,
+                                  OpenGL::TEXTURE_TRANSFORM_INVERT_Y);
+        }
+        renderer->end();
+    }
+}
+
+bool decoration_painter_t::set_level_of_detail(double level, bool simple) {
+    if ((level == lod) && (simple == simplified)) {
+        return false;
+    }
+
+    lod = level;
+    if (simple != simplified) {
+        simplified = simple;
+        update_opaque_region();
+    }
+    composite_damage |= geometry_t{ 0, 0, size.width, size.height };
+
+    return true;
+}
+
+bool decoration_painter_t::is_simplified() const {
+    return simplified;
+}
+
+void decoration_painter_t::damage_box(geometry_t box) {
+    this->composite_damage |= box;
+    damage_callback(box);
+}
+
+void decoration_painter_t::damage_areas(decoration_area_type_t type) {
+    for (const auto& area : layout.get_renderable_areas()) {
+        if (area.get_type() == type) {
+            damage_box(area.get_geometry());
+            if (type == DECORATION_AREA_TITLE) {
+                damage_box(area.get_dots_geometry());
+            }
+        }
+    }
+}
+
+void decoration_painter_t::damage_frame() {
+    for (const auto& box : cached_region) {
+        damage_box(wlr_box_from_pixman_box(box));
+    }
+}
+
+void decoration_painter_t::resize(dimensions_t dims) {
+    size = dims;
+	layout.resize(size.width, size.height, title.dims, title.dots_dims);
+	dirty |= DIRTY_LAYOUT | DIRTY_ACTIVATION;
+    if (!fullscreen) {
+        this->cached_region = layout.calculate_region();
+    }
+    update_opaque_region();
+}
+
+void decoration_painter_t::update_decoration_size(bool fullscreen) {
+    this->fullscreen = fullscreen;
+    damage_frame();
+    if (fullscreen) {
+        border_size = { 0, 0, 0, 0 };
+        this->cached_region.clear();
+    } else {
+        border_size = layout.parse_border(theme.get_border_size());
+        this->cached_region = layout.calculate_region();
+    }
+    update_opaque_region();
+    dirty |= DIRTY_LAYOUT;
+    damage_frame();
+}
+
+const decoration_theme_t& decoration_painter_t::get_theme() const {
+    return theme;
+}
+
+dimensions_t decoration_painter_t::get_size() const {
+    return size;
+}
+
+const border_size_t& decoration_painter_t::get_border_size() const {
+    return border_size;
+}
+
+decoration_layout_t& decoration_painter_t::get_layout() {
+    return layout;
+}
+
+const region_t& decoration_painter_t::get_region() const {
+    return cached_region;
+}
+
+const region_t& decoration_painter_t::get_opaque_region() const {
+    return opaque_region[activated];
+}
+}
@@ -0,0 +1,337 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <pango/pango.h>
+#include <wayfire/opengl.hpp>
+#include <wayfire/region.hpp>
+
+#include "firedecor-layout.hpp"
+#include "firedecor-renderer.hpp"
+#include "firedecor-theme.hpp"
+
+namespace wf::firedecor {
+
+/**
+ * Draws a decoration, and keeps everything it is drawn from: the theme, the
+ * layout, the rasterized assets and the regions of the frame. It knows nothing
+ * of the view, whose surface hands it the title, the app id and the state, so
+ * it can be driven without a compositor, as the tests and benchmarks do.
+ */
+class decoration_painter_t {
+  public:
+    /** A title as shown, and the sizes it takes */
+    struct title_measure_t {
+        std::string text;
+        dimensions_t dims, dots_dims;
+        bool too_big;
+    };
+
+    /**
+     * @param damage_callback Called with every box of the decoration, relative
+     *  to it, that has to be drawn again.
+     */
+    decoration_painter_t(theme_options options,
+                         std::shared_ptr<decoration_renderer_t> renderer,
+                         std::function<void(wlr_box)> damage_callback);
+    ~decoration_painter_t();
+
+    decoration_painter_t(const decoration_painter_t &) = delete;
+    decoration_painter_t(decoration_painter_t &&) = delete;
+    decoration_painter_t& operator =(const decoration_painter_t&) = delete;
+    decoration_painter_t& operator =(decoration_painter_t&&) = delete;
+
+    /**
+     * Measure a title. It only reads the theme, so it can run on any thread.
+     * @param view_title The title of the view, and view_app_id its app id.
+     * @param context The pango context of the calling thread, if it isn't the
+     *  main one.
+     */
+    static title_measure_t measure_title(const decoration_theme_t& theme,
+                                         const std::string& view_title,
+                                         const std::string& view_app_id,
+                                         int width, PangoContext *context = nullptr);
+
+    /** Show a measured title, placing the areas around it again */
+    void apply_title(title_measure_t&& measure);
+
+    /** Set the title of the view, measuring and placing it again */
+    void set_title(const std::string& title);
+
+    /** Set the app id of the view, its icon is formed on the next render */
+    void set_app_id(const std::string& app_id);
+
+    /** Set the activation and the tiled edges of the view */
+    void set_view_state(bool activated, uint32_t tiled_edges);
+
+    /**
+     * Draw the parts of the decoration inside the damage.
+     * @param origin The position of the decoration in the framebuffer.
+     */
+    void render(const render_target_t& fb, point_t origin, const region_t& damage);
+
+    /**
+     * Set the fraction of the output's resolution assets are rasterized at,
+     * and whether only a plain frame is drawn.
+     * @return True if either changed, and the decoration must be drawn again.
+     */
+    bool set_level_of_detail(double level, bool simple);
+
+    /** @return True if only the frame is drawn, the view being too small */
+    bool is_simplified() const;
+
+    /** The layout damages the parts of the frame that change */
+    void resize(dimensions_t dims);
+
+    /** Parse the border again, or drop it while the view is fullscreen */
+    void update_decoration_size(bool fullscreen);
+
+    /** Damage a box of the decoration, relative to it */
+    void damage_box(geometry_t box);
+
+    /** Damage the areas of a type, whose contents changed in place */
+    void damage_areas(decoration_area_type_t type);
+
+    /** Damage the whole frame, but not the view inside of it */
+    void damage_frame();
+
+    /** @return The theme of the decoration */
+    const decoration_theme_t& get_theme() const;
+
+    /** @return The size of the decoration, view included */
+    dimensions_t get_size() const;
+
+    /** @return The size of the border on each edge */
+    const border_size_t& get_border_size() const;
+
+    /** @return The layout of the areas, which handles the pointer too */
+    decoration_layout_t& get_layout();
+
+    /** @return The frame, where the decoration draws and takes input */
+    const region_t& get_region() const;
+
+    /** @return The fully opaque parts of the frame, for the view's activation */
+    const region_t& get_opaque_region() const;
+
+  private:
+    /** Accent variables */
+    struct accent_texture_t {
+        atlas_texture_t t_trbr[2];
+        atlas_texture_t t_tlbl[2];
+        int radius;
+    };
+
+    /**
+     * The assets rasterized for one output scale. A view shown on outputs of
+     * different scales keeps a set for each, so moving it between them, or
+     * spanning them, doesn't rasterize anything again.
+     */
+    struct scale_assets_t {
+        atlas_texture_t hor[2], hor_dots[2];
+        atlas_texture_t ver[2], ver_dots[2];
+        bool title_ready = false;
+
+        atlas_texture_t icon;
+        bool icon_ready = false;
+
+        /** The shared corners, in the order tr, tl, bl, br */
+        std::shared_ptr<corner_image_t> corners[4];
+        std::shared_ptr<border_image_t> border_image;
+        bool corners_ready = false;
+
+        /** Copies of the corners, made when accents need to cut into them */
+        atlas_texture_t own_tex[4][2];
+        cairo_surface_t *own_surf[4][2] = {};
+
+        /** The corners of each accent, formed the first time it is drawn */
+        std::vector<accent_texture_t> accents;
+
+        std::chrono::steady_clock::time_point last_used;
+
+        ~scale_assets_t();
+
+        /** Go back to drawing the shared images on every corner */
+        void drop_own_corners();
+    };
+
+    /** Title variables */
+    struct {
+        std::string text = "";
+        dimensions_t dims, dots_dims;
+        bool dots_set = false, too_big = true;
+    } title;
+
+    /** Icon variables */
+    struct {
+        std::string app_id = "";
+    } icon;
+
+    /** Corner variables */
+    struct corner_texture_t {
+        /** How to flip the shared top right corner into this corner */
+        uint32_t bits = 0;
+        geometry_t g;
+        int r;
+    };
+
+    struct {
+        corner_texture_t tr, tl, bl, br;
+    } corners;
+    /** The height of the corners their images were rasterized with */
+    int corner_height = 0;
+    int corner_radius;
+
+    /** What the surface told of the view */
+    std::string view_title, view_app_id;
+    bool activated = false;
+    uint32_t tiled_edges = 0;
+    bool fullscreen = false;
+
+    /** What needs to be computed again before the next render */
+    uint32_t dirty;
+
+    std::map<double, scale_assets_t> scale_assets;
+
+    /** The assets of the framebuffer being rendered to, and their scale */
+    scale_assets_t *current_assets = nullptr;
+    double current_scale = 1.0;
+
+    /**
+     * The fraction of the output's resolution assets are rasterized at. It
+     * drops in halves while transformers, like the ones of overviews, shrink
+     * the view, since the details would be lost when minifying anyway.
+     */
+    double lod = 1.0;
+    /** Whether the view is so small on screen that only its frame is drawn */
+    bool simplified = false;
+
+    /** Colors, premultiplied by their alpha, for each activation state */
+    struct {
+        color_t border[2], outline[2], accent[2];
+        double scale = 0;
+    } state;
+
+    /** Other general variables */
+    std::shared_ptr<decoration_renderer_t> renderer;
+    decoration_theme_t theme;
+    decoration_layout_t layout;
+    std::function<void(wlr_box)> damage_callback;
+    region_t cached_region;
+    dimensions_t size;
+    border_size_t border_size;
+
+    /** The boxes used as scissors on the last render, kept to reuse their storage */
+    std::vector<geometry_t> scissor_boxes;
+
+    /**
+     * With the software backend, the decoration is composited on the CPU into
+     * one image per edge, so it is drawn with four quads. Each image is only
+     * composited again where the decoration changed.
+     */
+    struct composite_strip_t {
+        geometry_t g = { 0, 0, 0, 0 };
+        cairo_surface_t *surface = nullptr;
+        atlas_texture_t tex;
+    };
+    composite_strip_t strips[4];
+
+    /** The parts of the decoration changed since they were last composited */
+    region_t composite_damage;
+
+    /** The fully opaque parts of the decoration, for each activation state */
+    region_t opaque_region[2];
+
+    using background_path_t =
+        void (decoration_painter_t::*)(point_t, const geometry_t&);
+
+    /**
+     * The specialization of render_background_areas() for the theme, picked
+     * once, without and with a border image.
+     */
+    background_path_t background_paths[2];
+
+    void update_title(scale_assets_t& assets, double scale);
+    void update_icon();
+    void update_layout();
+
+    /**
+     * Get the assets of a scale, rasterizing the ones it is missing. The sets of
+     * scales that weren't used for a while are freed here.
+     */
+    scale_assets_t& get_assets(double scale);
+
+    /**
+     * Calculate which parts of the decoration will be drawn fully opaque, so the
+     * compositor can skip rendering whatever lies beneath them. Corners are left
+     * out, since they are antialiased, and so are the rounded ends of accents.
+     * When simplified, the whole frame is filled with the border color.
+     */
+    void update_opaque_region();
+
+    /**
+     * Make a copy of the shared image of a scale, flipped into place, only for
+     * the corner of the given index, in the order tr, tl, bl, br.
+     */
+    void make_own_corner(scale_assets_t& assets, int index, int active);
+
+    void update_corners();
+
+    /**
+     * Bring everything the render path reads up to date. Only the parts marked
+     * as dirty are computed again, so this is nearly free in steady state.
+     */
+    void update_render_state(double scale);
+
+    void render_title(const render_target_t& fb, geometry_t geometry,
+                      geometry_t dots_geometry, edge_t edge, geometry_t scissor);
+    void render_icon(geometry_t g, int32_t bits);
+
+    /**
+     * Rasterize the corners of an accent at the scale of the assets, cutting
+     * the accent out of the corners of the view it overlaps.
+     */
+    void form_accent_corners(scale_assets_t& assets, double scale, int r,
+                             geometry_t accent, accent_style_t style,
+                             matrix<int> m, edge_t edge);
+
+    /** Record an accent, forming the textures of its corners the first time */
+    void render_accent(geometry_t g, point_t o, const geometry_t& scissor,
+                       accent_style_t style, unsigned long i, matrix<int> m,
+                       edge_t edge);
+
+    /**
+     * Record a plain part of the border, with its outline if the theme has one.
+     * Areas of every edge share one list, so the edge isn't a template
+     * parameter, it picks the side of the outline from a table instead.
+     */
+    template<bool OUTLINE>
+    void render_border_area(geometry_t g, point_t o, const geometry_t& scissor,
+                            edge_t edge);
+
+    /**
+     * Record the borders and accents. It is specialized on the outline of the
+     * theme and on the border image, so the loop over the areas only branches
+     * on what differs between them.
+     */
+    template<bool OUTLINE, bool BORDER_IMAGE>
+    void render_background_areas(point_t o, const geometry_t& scissor);
+
+    void render_background(const render_target_t& fb, geometry_t rect,
+                           const geometry_t& scissor);
+
+    void render_scissor_box(const render_target_t& fb, point_t origin,
+                            const wlr_box& scissor);
+
+    /** Record the quads of everything inside the scissor box in the renderer */
+    void record_scissor_box(const render_target_t& fb, point_t origin,
+                            const wlr_box& scissor);
+
+    /** Composite the changed parts of the decoration into its strips, on the CPU */
+    void update_strips(const render_target_t& fb);
+};
+}
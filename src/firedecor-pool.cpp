@@ -0,0 +1,100 @@
+#include "firedecor-pool.hpp"
+
+namespace wf {
+namespace firedecor {
+std::shared_ptr<texture_pool_t> texture_pool_t::get() {
+    static std::weak_ptr<texture_pool_t> instance;
+
+    auto pool = instance.lock();
+    if (!pool) {
+        pool = std::make_shared<texture_pool_t>();
+        instance = pool;
+    }
+
+    return pool;
+}
+
+texture_pool_t::~texture_pool_t() {
+    idle_timer.disconnect();
+    OpenGL::render_begin();
+    trim(0);
+    OpenGL::render_end();
+}
+
+wf::dimensions_t texture_pool_t::bucket_size(wf::dimensions_t size) {
+    auto round_up = [] (int length) {
+        return (length + POOL_BUCKET_STEP - 1) / POOL_BUCKET_STEP * POOL_BUCKET_STEP;
+    };
+
+    return { round_up(size.width), round_up(size.height) };
+}
+
+GLuint texture_pool_t::create_texture(wf::dimensions_t size) {
+    GLuint tex;
+    GL_CALL(glGenTextures(1, &tex));
+    GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
+    GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+    GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+    GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    /** Cairo stores pixels as BGRA, same as cairo_surface_upload_to_texture */
+    GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_BLUE));
+    GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED));
+    GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size.width, size.height,
+                         0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr));
+    return tex;
+}
+
+GLuint texture_pool_t::lease(wf::dimensions_t& size) {
+    size = bucket_size(size);
+
+    auto bucket = idle.find({ size.width, size.height });
+    if ((bucket == idle.end()) || bucket->second.empty()) {
+        return create_texture(size);
+    }
+
+    /** The newest one, which is the most likely to still be resident */
+    GLuint tex = bucket->second.back();
+    bucket->second.pop_back();
+    idle_bytes -= (size_t)size.width * size.height * 4;
+
+    return tex;
+}
+
+void texture_pool_t::give_back(GLuint tex, wf::dimensions_t size) {
+    idle[{ size.width, size.height }].push_back(tex);
+    idle_bytes += (size_t)size.width * size.height * 4;
+
+    if (idle_bytes > POOL_HIGH_WATER_MARK) {
+        OpenGL::render_begin();
+        trim(POOL_HIGH_WATER_MARK);
+        OpenGL::render_end();
+    }
+
+    /** Every return postpones the trimming */
+    idle_timer.disconnect();
+    idle_timer.set_timeout(POOL_IDLE_TIMEOUT, [=] () {
+        OpenGL::render_begin();
+        trim(0);
+        OpenGL::render_end();
+        return false;
+    });
+}
+
+void texture_pool_t::trim(size_t max_bytes) {
+    /** The largest buckets first, since they free the most per texture */
+    for (auto it = idle.rbegin(); (it != idle.rend()) && (idle_bytes > max_bytes);
+         ++it) {
+        auto& textures = it->second;
+        size_t bytes = (size_t)it->first.first * it->first.second * 4;
+        while (!textures.empty() && (idle_bytes > max_bytes)) {
+            GL_CALL(glDeleteTextures(1, &textures.front()));
+            textures.erase(textures.begin());
+            idle_bytes -= bytes;
+        }
+    }
+
+    std::erase_if(idle, [] (const auto& bucket) { return bucket.second.empty(); });
+}
+}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <vector>
+#include <wayfire/opengl.hpp>
+#include <wayfire/util.hpp>
+
+namespace wf {
+namespace firedecor {
+
+/** Texture sizes are rounded up to multiples of this, so close sizes share buckets */
+static constexpr int POOL_BUCKET_STEP = 64;
+/** The most memory idle textures may hold, in bytes */
+static constexpr size_t POOL_HIGH_WATER_MARK = 64 * 1024 * 1024;
+/** Milliseconds without leases after which every idle texture is freed */
+static constexpr int POOL_IDLE_TIMEOUT = 5000;
+
+/**
+ * A pool of GL textures, recycled between decorations, atlas pages and
+ * relayouts, instead of being deleted and created again.
+ *
+ * Textures are kept in buckets by their rounded up size, so a lease may get a
+ * texture larger than requested. Every texture is set up the same way, with
+ * linear filtering, clamping to the edges, and swizzling from cairo's BGRA.
+ */
+class texture_pool_t {
+  public:
+    /** @return The pool shared by every output, created on demand */
+    static std::shared_ptr<texture_pool_t> get();
+
+    texture_pool_t() = default;
+    ~texture_pool_t();
+
+    texture_pool_t(const texture_pool_t &) = delete;
+    texture_pool_t(texture_pool_t &&) = delete;
+    texture_pool_t& operator =(const texture_pool_t&) = delete;
+    texture_pool_t& operator =(texture_pool_t&&) = delete;
+
+    /**
+     * Lease a texture with undefined contents. Must be called with the GL
+     * context current.
+     * @param size The size needed, replaced by the size of the texture's storage.
+     */
+    GLuint lease(wf::dimensions_t& size);
+
+    /** Give a leased texture back, along with the size of its storage */
+    void give_back(GLuint tex, wf::dimensions_t size);
+
+    /**
+     * Free idle textures until they take at most max_bytes. Must be called with
+     * the GL context current.
+     */
+    void trim(size_t max_bytes);
+
+    /** @return The size of the storage a lease of the given size gets */
+    static wf::dimensions_t bucket_size(wf::dimensions_t size);
+
+  private:
+    /** Idle textures, by the size of their storage, the oldest ones first */
+    std::map<std::pair<int, int>, std::vector<GLuint>> idle;
+    size_t idle_bytes = 0;
+
+    wf::wl_timer idle_timer;
+
+    /** @return A new texture, with undefined contents */
+    static GLuint create_texture(wf::dimensions_t size);
+};
+}
+}
@@ -0,0 +1,446 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#include "firedecor-renderer.hpp"
+
+namespace wf {
+namespace firedecor {
+/** Floats per vertex: position, uv, color and solidness */
+static constexpr int VERTEX_SIZE = 9;
+
+static const char *batch_vertex_source = R"(
+#version 100
+attribute highp vec2 position;
+attribute highp vec2 uvPosition;
+attribute highp vec4 color;
+attribute highp float solid;
+
+varying highp vec2 uv;
+varying highp vec4 fcolor;
+varying highp float fsolid;
+
+uniform mat4 MVP;
+
+void main() {
+    gl_Position = MVP * vec4(position, 0.0, 1.0);
+    uv     = uvPosition;
+    fcolor = color;
+    fsolid = solid;
+}
+)";
+
+/** Solid quads ignore the texture, so they can join any run */
+static const char *batch_fragment_source = R"(
+#version 100
+varying highp vec2 uv;
+varying highp vec4 fcolor;
+varying highp float fsolid;
+
+uniform sampler2D smp;
+
+void main() {
+    gl_FragColor = mix(texture2D(smp, uv), vec4(1.0), fsolid) * fcolor;
+}
+)";
+
+/** @return True if the GL implementation rasterizes on the CPU */
+static bool is_software_gl() {
+    OpenGL::render_begin();
+    auto *name = (const char*)glGetString(GL_RENDERER);
+    OpenGL::render_end();
+
+    std::string renderer = name ? name : "";
+    for (auto *software : { "llvmpipe", "softpipe", "swrast", "SwiftShader" }) {
+        if (renderer.find(software) != std::string::npos) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+decoration_renderer_t::decoration_renderer_t() {
+    this->software = is_software_gl();
+    if (software) {
+        atlas->set_keep_pixels(true);
+    }
+}
+
+decoration_renderer_t::~decoration_renderer_t() {
+    if (solid_image) {
+        pixman_image_unref(solid_image);
+    }
+
+    if (program_ready) {
+        OpenGL::render_begin();
+        program.free_resources();
+        OpenGL::render_end();
+    }
+}
+
+void decoration_renderer_t::begin(const wf::render_target_t& fb,
+                                  wf::geometry_t scissor) {
+    this->target  = nullptr;
+    this->fb      = &fb;
+    this->scissor = scissor;
+    this->items.clear();
+}
+
+void decoration_renderer_t::add_rectangle(draw_layer_t layer, wf::geometry_t g,
+                                          wf::color_t color) {
+    draw_item_t item = {
+        layer, (GLuint)-1, {}, g, color, 0, nullptr, {}, (uint32_t)items.size()
+    };
+    if (batched || target) {
+        items.push_back(item);
+        return;
+    }
+
+    OpenGL::render_begin(*fb);
+    fb->logic_scissor(scissor);
+    draw(item, fb->get_orthographic_projection());
+    OpenGL::render_end();
+}
+
+void decoration_renderer_t::add_texture(draw_layer_t layer,
+                                        const atlas_texture_t& tex,
+                                        wf::geometry_t g, uint32_t bits) {
+    auto size = tex.get_size();
+    add_texture_part(layer, tex, g, { 0, 0, size.width, size.height }, bits);
+}
+
+void decoration_renderer_t::add_nine_slice(draw_layer_t layer,
+                                           const atlas_texture_t& tex,
+                                           wf::geometry_t g, slice_insets_t source,
+                                           slice_insets_t target, bool center) {
+    auto size = tex.get_size();
+    int src_x[4] = { 0, source.left, size.width - source.right, size.width };
+    int src_y[4] = { 0, source.top, size.height - source.bottom, size.height };
+    int dst_x[4] = { g.x, g.x + target.left, g.x + g.width - target.right,
+                     g.x + g.width };
+    int dst_y[4] = { g.y, g.y + target.top, g.y + g.height - target.bottom,
+                     g.y + g.height };
+
+    for (int row = 0; row < 3; row++) {
+        for (int column = 0; column < 3; column++) {
+            if (!center && (row == 1) && (column == 1)) {
+                continue;
+            }
+
+            wf::geometry_t part = {
+                src_x[column], src_y[row], src_x[column + 1] - src_x[column],
+                src_y[row + 1] - src_y[row]
+            };
+            wf::geometry_t box = {
+                dst_x[column], dst_y[row], dst_x[column + 1] - dst_x[column],
+                dst_y[row + 1] - dst_y[row]
+            };
+            if ((part.width > 0) && (part.height > 0) &&
+                (box.width > 0) && (box.height > 0)) {
+                add_texture_part(layer, tex, box, part,
+                                 OpenGL::TEXTURE_TRANSFORM_INVERT_Y);
+            }
+        }
+    }
+}
+
+void decoration_renderer_t::add_texture_part(draw_layer_t layer,
+                                             const atlas_texture_t& tex,
+                                             wf::geometry_t g, wf::geometry_t part,
+                                             uint32_t bits) {
+    if (target ? !tex.get_surface() : (tex.get_texture() == (GLuint)-1)) {
+        return;
+    }
+
+    draw_item_t item = {
+        layer, tex.get_texture(), tex.get_uv(bits, part), g, { 1, 1, 1, 1 }, bits,
+        tex.get_surface(), part, (uint32_t)items.size()
+    };
+    if (batched || target) {
+        items.push_back(item);
+        return;
+    }
+
+    OpenGL::render_begin(*fb);
+    fb->logic_scissor(scissor);
+    draw(item, fb->get_orthographic_projection());
+    OpenGL::render_end();
+}
+
+void decoration_renderer_t::end() {
+    if (items.empty()) {
+        return;
+    }
+
+    /**
+     * Overlapping quads of the same texture keep their order. std::stable_sort
+     * would get a buffer from the heap on every call, so the order is a key.
+     */
+    std::sort(items.begin(), items.end(),
+              [](const draw_item_t& a, const draw_item_t& b) {
+        if (a.layer != b.layer) {
+            return a.layer < b.layer;
+        }
+        if (a.tex != b.tex) {
+            return (a.tex + 1) < (b.tex + 1);
+        }
+        return a.order < b.order;
+    });
+
+    OpenGL::render_begin(*fb);
+    if (!program_ready) {
+        program.compile(batch_vertex_source, batch_fragment_source);
+        program_ready = true;
+    }
+
+    fb->logic_scissor(scissor);
+    auto projection = fb->get_orthographic_projection();
+
+    /** A run ends at the first quad with another texture */
+    GLuint run_tex = (GLuint)-1;
+    for (auto& item : items) {
+        if ((item.tex != (GLuint)-1) && (item.tex != run_tex)) {
+            draw_run(run_tex, projection);
+            run_tex = item.tex;
+        }
+
+        push_vertices(item);
+    }
+
+    draw_run(run_tex, projection);
+    program.deactivate();
+    OpenGL::render_end();
+
+    items.clear();
+}
+
+void decoration_renderer_t::push_vertices(const draw_item_t& item) {
+    float x1 = item.geometry.x;
+    float y1 = item.geometry.y;
+    float x2 = item.geometry.x + item.geometry.width;
+    float y2 = item.geometry.y + item.geometry.height;
+    float solid = (item.tex == (GLuint)-1) ? 1 : 0;
+    const auto& c = item.color;
+
+    /** The inversion bits are already applied to the uv */
+    const GLfloat corners[4][4] = {
+        { x1, y1, item.uv.x1, item.uv.y1 }, { x2, y1, item.uv.x2, item.uv.y1 },
+        { x2, y2, item.uv.x2, item.uv.y2 }, { x1, y2, item.uv.x1, item.uv.y2 },
+    };
+    for (int corner : { 0, 1, 2, 0, 2, 3 }) {
+        const auto *v = corners[corner];
+        vertices.insert(vertices.end(), {
+            v[0], v[1], v[2], v[3], (GLfloat)c.r, (GLfloat)c.g, (GLfloat)c.b,
+            (GLfloat)c.a, solid
+        });
+    }
+}
+
+void decoration_renderer_t::draw_run(GLuint tex, const glm::mat4& projection) {
+    if (vertices.empty()) {
+        return;
+    }
+
+    program.use(wf::TEXTURE_TYPE_RGBA);
+    if (tex != (GLuint)-1) {
+        GL_CALL(glActiveTexture(GL_TEXTURE0));
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
+    }
+
+    const int stride = VERTEX_SIZE * sizeof(GLfloat);
+    const GLfloat *data = vertices.data();
+    program.attrib_pointer("position", 2, stride, data);
+    program.attrib_pointer("uvPosition", 2, stride, data + 2);
+    program.attrib_pointer("color", 4, stride, data + 4);
+    program.attrib_pointer("solid", 1, stride, data + 8);
+    program.uniformMatrix4f("MVP", projection);
+    program.uniform1i("smp", 0);
+
+    /** Colors and textures are premultiplied */
+    GL_CALL(glEnable(GL_BLEND));
+    GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+    GL_CALL(glDrawArrays(GL_TRIANGLES, 0, vertices.size() / VERTEX_SIZE));
+
+    vertices.clear();
+}
+
+void decoration_renderer_t::set_batched(bool batched) {
+    this->batched = batched;
+}
+
+void decoration_renderer_t::begin_composite(cairo_surface_t *target,
+                                            wf::point_t offset, double scale) {
+    this->target = target;
+    this->offset = offset;
+    this->scale  = scale;
+    this->items.clear();
+}
+
+pixman_box32_t decoration_renderer_t::to_target(wf::geometry_t box) const {
+    /** Rounding both edges keeps neighbouring boxes touching */
+    return {
+        (int32_t)std::lround((box.x - offset.x) * scale),
+        (int32_t)std::lround((box.y - offset.y) * scale),
+        (int32_t)std::lround((box.x + box.width - offset.x) * scale),
+        (int32_t)std::lround((box.y + box.height - offset.y) * scale)
+    };
+}
+
+/** Where the pixman image over the pixels of a surface is kept */
+static const cairo_user_data_key_t pixman_image_key = {};
+
+/**
+ * @return The pixman image over the pixels of the surface. It is created on
+ *         first use and lives as long as the surface does.
+ */
+static pixman_image_t *image_of(cairo_surface_t *surface) {
+    auto *image =
+        (pixman_image_t*)cairo_surface_get_user_data(surface, &pixman_image_key);
+    if (!image) {
+        image = pixman_image_create_bits(PIXMAN_a8r8g8b8,
+                                         cairo_image_surface_get_width(surface),
+                                         cairo_image_surface_get_height(surface),
+                                         (uint32_t*)cairo_image_surface_get_data(surface),
+                                         cairo_image_surface_get_stride(surface));
+        cairo_surface_set_user_data(surface, &pixman_image_key, image, [](void *data) {
+            pixman_image_unref((pixman_image_t*)data);
+        });
+    }
+
+    return image;
+}
+
+void decoration_renderer_t::end_composite(const wf::region_t& clip) {
+    cairo_surface_flush(target);
+    auto *dst  = image_of(target);
+    auto *bits = (uint32_t*)cairo_image_surface_get_data(target);
+    int stride = cairo_image_surface_get_stride(target) / 4;
+    int width  = cairo_image_surface_get_width(target);
+    int height = cairo_image_surface_get_height(target);
+
+    if (!solid_image) {
+        solid_image = pixman_image_create_bits(PIXMAN_a8r8g8b8, 1, 1, &solid_pixel, 4);
+        pixman_image_set_repeat(solid_image, PIXMAN_REPEAT_NORMAL);
+    }
+
+    std::sort(items.begin(), items.end(),
+              [](const draw_item_t& a, const draw_item_t& b) {
+        return (a.layer != b.layer) ? (a.layer < b.layer) : (a.order < b.order);
+    });
+
+    /**
+     * Box by box, instead of through a clip region on the target, which pixman
+     * would intersect with every item on the heap.
+     */
+    for (const auto& box : clip) {
+        auto b = to_target(wlr_box_from_pixman_box(box));
+        b.x1 = std::max(b.x1, 0);
+        b.y1 = std::max(b.y1, 0);
+        b.x2 = std::min(b.x2, width);
+        b.y2 = std::min(b.y2, height);
+        if ((b.x1 >= b.x2) || (b.y1 >= b.y2)) {
+            continue;
+        }
+
+        /** Whatever was there is drawn again from scratch */
+        pixman_fill(bits, stride, 32, b.x1, b.y1, b.x2 - b.x1, b.y2 - b.y1, 0);
+        for (auto& item : items) {
+            composite(item, dst, b);
+        }
+    }
+
+    cairo_surface_mark_dirty(target);
+
+    items.clear();
+    target = nullptr;
+}
+
+void decoration_renderer_t::composite(const draw_item_t& item, pixman_image_t *dst,
+                                      const pixman_box32_t& box) {
+    auto d = to_target(item.geometry);
+    int width  = d.x2 - d.x1;
+    int height = d.y2 - d.y1;
+    if ((width <= 0) || (height <= 0)) {
+        return;
+    }
+
+    /** The part of the item inside the box */
+    int x1 = std::max(d.x1, box.x1);
+    int y1 = std::max(d.y1, box.y1);
+    int x2 = std::min(d.x2, box.x2);
+    int y2 = std::min(d.y2, box.y2);
+    if ((x1 >= x2) || (y1 >= y2)) {
+        return;
+    }
+
+    pixman_image_t *src;
+    int src_x = x1 - d.x1;
+    int src_y = y1 - d.y1;
+    if (!item.surface) {
+        /** Colors are already premultiplied, and rounded as pixman fills would */
+        auto channel = [] (double value) { return (uint32_t)(value * 0xffff) >> 8; };
+        solid_pixel = (channel(item.color.a) << 24) | (channel(item.color.r) << 16) |
+                      (channel(item.color.g) << 8) | channel(item.color.b);
+        src = solid_image;
+    } else {
+        const auto& p = item.part;
+        src = image_of(item.surface);
+
+        /**
+         * Same orientation as on the GPU, where textures drawn without
+         * TEXTURE_TRANSFORM_INVERT_Y come out upside down.
+         */
+        bool flip_x = item.bits & OpenGL::TEXTURE_TRANSFORM_INVERT_X;
+        bool flip_y = !(item.bits & OpenGL::TEXTURE_TRANSFORM_INVERT_Y);
+        double sx = flip_x ? -(double)p.width / width : (double)p.width / width;
+        double sy = flip_y ? -(double)p.height / height : (double)p.height / height;
+
+        /**
+         * pixman frees the transform of an image set to the identity, and
+         * allocates it again for the next one. Sampling from one pixel before
+         * and moving the part by as much keeps it from ever being the identity,
+         * since parts never start before their surface.
+         */
+        pixman_transform_t transform;
+        pixman_transform_init_identity(&transform);
+        transform.matrix[0][0] = pixman_double_to_fixed(sx);
+        transform.matrix[0][2] = pixman_double_to_fixed((flip_x ? p.x + p.width : p.x) + sx);
+        transform.matrix[1][1] = pixman_double_to_fixed(sy);
+        transform.matrix[1][2] = pixman_double_to_fixed((flip_y ? p.y + p.height : p.y) + sy);
+        pixman_image_set_transform(src, &transform);
+        src_x -= 1;
+        src_y -= 1;
+
+        bool scaled = (p.width != width) || (p.height != height);
+        pixman_image_set_filter(src, scaled ? PIXMAN_FILTER_BILINEAR :
+                                PIXMAN_FILTER_NEAREST, nullptr, 0);
+        pixman_image_set_repeat(src, PIXMAN_REPEAT_PAD);
+    }
+
+    pixman_image_composite32(PIXMAN_OP_OVER, src, nullptr, dst, src_x, src_y, 0, 0,
+                             x1, y1, x2 - x1, y2 - y1);
+}
+
+bool decoration_renderer_t::is_software() const {
+    return software;
+}
+
+void decoration_renderer_t::draw(const draw_item_t& item,
+                                 const glm::mat4& projection) {
+    if (item.tex == (GLuint)-1) {
+        OpenGL::render_rectangle(item.geometry, item.color, projection);
+    } else {
+        gl_geometry g = {
+            (float)item.geometry.x, (float)item.geometry.y,
+            (float)(item.geometry.x + item.geometry.width),
+            (float)(item.geometry.y + item.geometry.height)
+        };
+        /** The inversion bits are already applied to the uv */
+        OpenGL::render_transformed_texture(item.tex, g, item.uv, projection,
+                                           glm::vec4(1.0f),
+                                           OpenGL::TEXTURE_USE_TEX_GEOMETRY);
+    }
+}
+}
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <vector>
+#include <cairo.h>
+#include <pixman.h>
+#include <wayfire/opengl.hpp>
+#include <wayfire/region.hpp>
+#include <wayfire/plugins/common/simple-texture.hpp>
+
+#include "firedecor-atlas.hpp"
+
+namespace wf {
+namespace firedecor {
+
+/** Layers of a decoration, drawn from the bottom to the top */
+enum draw_layer_t {
+    /** Images stretched over the whole frame, such as border images and shadows */
+    LAYER_FRAME      = 0,
+    /** Solid rectangles of the background, outlines and accents */
+    LAYER_BACKGROUND = 1,
+    /** Textures on the background, that is, corners and accent edges */
+    LAYER_EDGES      = 2,
+    /** Titles, icons and buttons */
+    LAYER_CONTENT    = 3,
+};
+
+/** A single quad, either textured or solid, waiting to be drawn */
+struct draw_item_t {
+    draw_layer_t layer;
+    /** The texture to draw, or (GLuint)-1 for a solid rectangle */
+    GLuint tex;
+    /** The part of the texture to draw, which matters for atlas pages */
+    gl_geometry uv;
+    wf::geometry_t geometry;
+    wf::color_t color;
+    uint32_t bits;
+    /** The pixels of the texture, used when compositing on the CPU */
+    cairo_surface_t *surface;
+    /** The part of the surface to draw, in its pixels */
+    wf::geometry_t part;
+    /** The position of the item in the recording, which ties are broken by */
+    uint32_t order;
+};
+
+
+/**
+ * Draws the decorations of one output.
+ *
+ * Decorations record their quads here instead of issuing GL calls directly. In
+ * batched mode, the quads are sorted by layer and texture, written into one
+ * vertex array per scissor box, and drawn with one glDrawArrays() per run of
+ * quads sharing a texture. Since most assets share atlas pages, a decoration
+ * usually takes a handful of draw calls. Otherwise, every quad is drawn as soon
+ * as it is recorded, which is what decorations used to do on their own.
+ *
+ * Quads are not collected over the whole output, since decorations are drawn
+ * between the views of the output, and a decoration drawn late would cover the
+ * views that are above its own.
+ *
+ * On software GL implementations, such as llvmpipe, every quad costs a full
+ * pass of the CPU over its pixels. There, decorations instead composite their
+ * quads with pixman into CPU images once, when they change, and draw those.
+ */
+class decoration_renderer_t {
+  public:
+    decoration_renderer_t();
+    ~decoration_renderer_t();
+
+    decoration_renderer_t(const decoration_renderer_t &) = delete;
+    decoration_renderer_t(decoration_renderer_t &&) = delete;
+    decoration_renderer_t& operator =(const decoration_renderer_t&) = delete;
+    decoration_renderer_t& operator =(decoration_renderer_t&&) = delete;
+
+    /**
+     * Start recording the quads for a scissor box.
+     * @param fb The target framebuffer.
+     * @param scissor The scissor box, in logical coordinates.
+     */
+    void begin(const wf::render_target_t& fb, wf::geometry_t scissor);
+
+    /** Record a solid rectangle */
+    void add_rectangle(draw_layer_t layer, wf::geometry_t g, wf::color_t color);
+
+    /** Record a textured quad, from a texture that may live in the atlas */
+    void add_texture(draw_layer_t layer, const atlas_texture_t& tex,
+                     wf::geometry_t g, uint32_t bits = 0);
+
+    /** Record a textured quad, from a part of the texture, in its pixels */
+    void add_texture_part(draw_layer_t layer, const atlas_texture_t& tex,
+                          wf::geometry_t g, wf::geometry_t part, uint32_t bits = 0);
+
+    /**
+     * Record a nine-slice image stretched over a box. The corners are drawn
+     * as they are, the edges are stretched along the box, and so is the center,
+     * if it is drawn at all. The image is drawn upright, as cairo sees it.
+     * @param source The insets of the slices, in the pixels of the texture.
+     * @param target The insets of the slices in the box, in logical pixels.
+     */
+    void add_nine_slice(draw_layer_t layer, const atlas_texture_t& tex,
+                        wf::geometry_t g, slice_insets_t source,
+                        slice_insets_t target, bool center);
+
+    /** Submit everything that was recorded since begin() */
+    void end();
+
+    /** Set if the quads are batched, or drawn as soon as they are recorded */
+    void set_batched(bool batched);
+
+    /**
+     * Start recording quads to be composited on the CPU.
+     * @param target The image to composite into.
+     * @param offset The position of the image, in logical coordinates.
+     * @param scale The scale of the image.
+     */
+    void begin_composite(cairo_surface_t *target, wf::point_t offset, double scale);
+
+    /**
+     * Composite everything recorded since begin_composite(). Only the parts
+     * inside clip, in logical coordinates, are cleared and drawn again.
+     */
+    void end_composite(const wf::region_t& clip);
+
+    /** @return True if decorations should be composited on the CPU */
+    bool is_software() const;
+
+  private:
+    bool batched  = true;
+    bool software = false;
+    const wf::render_target_t *fb = nullptr;
+    wf::geometry_t scissor;
+
+    /** Kept alive so that assets keep their pixels in software mode */
+    std::shared_ptr<texture_atlas_t> atlas = texture_atlas_t::get();
+
+    /** The target of the current composite, if compositing on the CPU */
+    cairo_surface_t *target = nullptr;
+    wf::point_t offset;
+    double scale = 1;
+
+    /** Solid rectangles are composited from this pixel, repeated */
+    pixman_image_t *solid_image = nullptr;
+    uint32_t solid_pixel = 0;
+
+    /** The storage is kept between scissor boxes and between decorations */
+    std::vector<draw_item_t> items;
+
+    /** Draws whole runs of quads, compiled on first use */
+    OpenGL::program_t program;
+    bool program_ready = false;
+
+    /** Position, uv, color and solidness of every vertex, interleaved */
+    std::vector<GLfloat> vertices;
+
+    /** Append the two triangles of an item to the vertex array */
+    void push_vertices(const draw_item_t& item);
+
+    /** Draw the vertices of a run of items sharing a texture */
+    void draw_run(GLuint tex, const glm::mat4& projection);
+
+    /** Draw a single item, with the GL state already set up */
+    void draw(const draw_item_t& item, const glm::mat4& projection);
+
+    /** @return The box, relative to the target, in its pixels */
+    pixman_box32_t to_target(wf::geometry_t box) const;
+
+    /** Composite the part of an item inside a box of the target, on the CPU */
+    void composite(const draw_item_t& item, pixman_image_t *dst,
+                   const pixman_box32_t& box);
+};
+}
+}
@@ -2,11 +2,19 @@
 
 #include <wayfire/view.hpp>
 
+#include "firedecor-renderer.hpp"
 #include "firedecor-theme.hpp"
 
 namespace wf::firedecor {
 
-void init_view(wayfire_view view, wf::firedecor::theme_options options);
+void init_view(wayfire_view view, wf::firedecor::theme_options options,
+               std::shared_ptr<decoration_renderer_t> renderer);
 void deinit_view(wayfire_view view);
 
+/**
+ * Measure the titles of the decorations of many views on a few threads, then
+ * relayout the decorations with the results, in one pass on the calling thread.
+ */
+void relayout_views(const std::vector<wayfire_view>& views);
+
 }
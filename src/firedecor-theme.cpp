@@ -3,6 +3,9 @@
 #include <wayfire/config.h>
 
 #include <map>
+#include <cmath>
+#include <array>
+#include <tuple>
 #include <string>
 #include <fstream>
 #include <algorithm>
@@ -20,7 +23,54 @@ namespace wf {
 namespace firedecor {
 /** Create a new theme with the default parameters */
 decoration_theme_t::decoration_theme_t(wf::firedecor::theme_options options) :
-    theme_options{options} {}
+    theme_options{options} {
+	std::stringstream stream(round_on.get_value());
+	std::string corner;
+
+	round_on_bits = 0;
+	while (stream >> corner) {
+		if (corner == "all") {
+			round_on_bits = CORNER_ALL;
+		} else if (corner == "tr") {
+			round_on_bits |= CORNER_TR;
+		} else if (corner == "tl") {
+			round_on_bits |= CORNER_TL;
+		} else if (corner == "bl") {
+			round_on_bits |= CORNER_BL;
+		} else if (corner == "br") {
+			round_on_bits |= CORNER_BR;
+		}
+	}
+
+	if (quality.get_value() == "fast") {
+		quality_tier = QUALITY_FAST;
+	} else if (quality.get_value() == "balanced") {
+		quality_tier = QUALITY_BALANCED;
+	} else {
+		quality_tier = QUALITY_FULL;
+	}
+
+	/** Square corners mean a single flat corner, shared by every decoration */
+	if (quality_tier == QUALITY_FAST) {
+		round_on_bits = 0;
+	}
+
+	/** Same format as border_size */
+	std::stringstream slice_stream(border_image_slice.get_value());
+	int slice[4] = { 0, 0, 0, 0 };
+	int count = 0;
+	while ((count < 4) && (slice_stream >> slice[count])) {
+		count++;
+	}
+
+	if (count == 1 || count == 3) {
+		border_slice = { slice[0], slice[0], slice[0], slice[0] };
+	} else if (count == 2) {
+		border_slice = { slice[0], slice[1], slice[1], slice[1] };
+	} else {
+		border_slice = { slice[0], slice[1], slice[2], slice[3] };
+	}
+}
 
 std::string decoration_theme_t::get_layout() const {
 	return layout.get_value();
@@ -96,8 +146,20 @@ bool decoration_theme_t::has_title_orientation(orientation_t orientation) const
 bool decoration_theme_t::get_debug_mode() const {
     return debug_mode.get_value();
 }
-std::string decoration_theme_t::get_round_on() const {
-    return round_on.get_value();
+uint32_t decoration_theme_t::get_round_on() const {
+    return round_on_bits;
+}
+
+int decoration_theme_t::get_shadow_margin() const {
+    return shadow_radius.get_value() + shadow_spread.get_value();
+}
+
+quality_t decoration_theme_t::get_quality() const {
+    return quality_tier;
+}
+
+bool decoration_theme_t::has_border_image() const {
+    return (border_image.get_value() != "none") && !border_image.get_value().empty();
 }
 
 wf::dimensions_t decoration_theme_t::get_text_size(std::string text, int width) const {
@@ -123,8 +185,25 @@ wf::dimensions_t decoration_theme_t::get_text_size(std::string text, int width)
     return { text_size.width, text_size.height };
 }
 
+wf::dimensions_t decoration_theme_t::get_text_size(const std::string& text,
+                                                   PangoContext *context) const {
+    PangoRectangle text_size;
+
+    auto *font_desc = pango_font_description_from_string(((std::string)font.get_value()).c_str());
+    pango_font_description_set_absolute_size(font_desc, font_size.get_value() * PANGO_SCALE);
+    auto *layout = pango_layout_new(context);
+    pango_layout_set_font_description(layout, font_desc);
+    pango_layout_set_text(layout, text.c_str(), text.size());
+    pango_layout_get_pixel_extents(layout, NULL, &text_size);
+    pango_font_description_free(font_desc);
+    g_object_unref(layout);
+
+    return { text_size.width, text_size.height };
+}
+
 cairo_surface_t* decoration_theme_t::form_title(std::string text,
-    wf::dimensions_t title_size, bool active, orientation_t orientation) const {
+    wf::dimensions_t title_size, bool active, orientation_t orientation,
+    double scale) const {
     const auto format = CAIRO_FORMAT_ARGB32;
     cairo_surface_t* surface;
     if (orientation == HORIZONTAL) {
@@ -144,6 +223,7 @@ cairo_surface_t* decoration_theme_t::form_title(std::string text,
 	    cairo_rotate(cr, -M_PI / 2);
 	    cairo_translate(cr, -radius, -radius);
     }
+    cairo_scale(cr, scale, scale);
 
     PangoFontDescription *font_desc;
     PangoLayout *layout;
@@ -167,15 +247,19 @@ cairo_surface_t* decoration_theme_t::form_title(std::string text,
 cairo_surface_t *decoration_theme_t::form_corner(bool active, int r, 
                                                  matrix<double> m, 
                                                  int height) const {
-    double c_r = corner_radius.get_value() * abs(m.xx);
-	double o_r = c_r - abs(m.xx) * (double)outline_size.get_value() / 2;
+    /** The magnitude of the matrix is the scale, its signs are the flips */
+    double scale = abs(m.xx);
+    double c_r = corner_radius.get_value();
+	double o_r = c_r - (double)outline_size.get_value() / 2;
 
     const auto format = CAIRO_FORMAT_ARGB32;
-    auto *surface = cairo_image_surface_create(format, c_r, height);
+    auto *surface = cairo_image_surface_create(format, ceil(c_r * scale),
+                                               ceil(height * scale));
     auto cr = cairo_create(surface);
 
+    cairo_scale(cr, scale, scale);
     cairo_translate(cr, c_r / 2, (double)height / 2);
-    cairo_scale(cr, m.xx, m.yy);
+    cairo_scale(cr, m.xx / scale, m.yy / scale);
     cairo_translate(cr, -c_r / 2, -(double)height / 2);
 
     cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
@@ -198,7 +282,7 @@ cairo_surface_t *decoration_theme_t::form_corner(bool active, int r,
     /* Outline */
 	color = active ? active_outline.get_value() : inactive_outline.get_value();
     cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
-    cairo_set_line_width(cr, outline_size.get_value() * abs(m.xx));
+    cairo_set_line_width(cr, outline_size.get_value());
     if (r > 0) {
         cairo_move_to(cr, o_r, 0);
         cairo_line_to(cr, o_r, height - c_r);
@@ -215,8 +299,278 @@ cairo_surface_t *decoration_theme_t::form_corner(bool active, int r,
     return surface;
 }
 
+corner_image_t::~corner_image_t() {
+    for (auto surface : surf) {
+        if (surface) {
+            cairo_surface_destroy(surface);
+        }
+    }
+}
+
+std::shared_ptr<corner_image_t> decoration_theme_t::get_corner(int r, int height,
+                                                               double scale) const {
+    /** Everything form_corner() depends on */
+    using key_t = std::tuple<int, int, double, int, int, std::array<double, 16>>;
+    static std::map<key_t, std::weak_ptr<corner_image_t>> cache;
+
+    std::array<double, 16> colors;
+    int i = 0;
+    for (auto c : { active_border.get_value(), inactive_border.get_value(),
+                    active_outline.get_value(), inactive_outline.get_value() }) {
+        for (auto component : { c.r, c.g, c.b, c.a }) {
+            colors[i++] = component;
+        }
+    }
+    key_t key = { r, height, scale, corner_radius.get_value(),
+                  outline_size.get_value(), colors };
+
+    /** Corners no decoration uses anymore are dropped here */
+    std::erase_if(cache, [](const auto& entry) { return entry.second.expired(); });
+
+    if (auto it = cache.find(key); it != cache.end()) {
+        return it->second.lock();
+    }
+
+    auto image = std::make_shared<corner_image_t>();
+    for (auto a : { true, false }) {
+        image->surf[a] = form_corner(a, r, { scale, 0, 0, scale }, height);
+        image->tex[a].upload(image->surf[a]);
+    }
+    cache[key] = image;
+
+    return image;
+}
+
+shadow_image_t::~shadow_image_t() {
+    if (surf) {
+        cairo_surface_destroy(surf);
+    }
+}
+
+cairo_surface_t *decoration_theme_t::form_shadow(double scale) const {
+    int margin = std::round(get_shadow_margin() * scale);
+    int radius = std::min((int)std::round(shadow_radius.get_value() * scale), margin);
+    int spread = margin - radius;
+    int inset  = std::round(std::max(corner_radius.get_value(), 1) * scale);
+    int c_r    = std::round(corner_radius.get_value() * scale);
+    int length = 2 * (margin + inset) + 1;
+
+    /** A rectangle with the corners of round_on, through cairo, for antialiasing */
+    auto rounded_rect = [&] (cairo_t *cr, double x, double y, double size, double r) {
+        auto radius_of = [&] (uint32_t corner) {
+            return (get_round_on() & corner) ? r : 0.0;
+        };
+        double tr = radius_of(CORNER_TR), br = radius_of(CORNER_BR);
+        double bl = radius_of(CORNER_BL), tl = radius_of(CORNER_TL);
+
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x + size - tr, y + tr, tr, -M_PI / 2, 0);
+        cairo_arc(cr, x + size - br, y + size - br, br, 0, M_PI / 2);
+        cairo_arc(cr, x + bl, y + size - bl, bl, M_PI / 2, M_PI);
+        cairo_arc(cr, x + tl, y + tl, tl, M_PI, 3 * M_PI / 2);
+        cairo_close_path(cr);
+    };
+
+    auto form_mask = [&] (double offset, double r) {
+        auto *mask = cairo_image_surface_create(CAIRO_FORMAT_A8, length, length);
+        auto cr = cairo_create(mask);
+        rounded_rect(cr, offset, offset, length - 2 * offset, r);
+        cairo_fill(cr);
+        cairo_destroy(cr);
+        cairo_surface_flush(mask);
+        return mask;
+    };
+
+    /** The frame grown by the spread, which is what gets blurred */
+    auto *shape = form_mask(margin - spread, c_r + spread);
+    std::vector<float> alpha(length * length), blurred(length * length);
+    auto *shape_data = cairo_image_surface_get_data(shape);
+    int shape_stride = cairo_image_surface_get_stride(shape);
+    for (int y = 0; y < length; y++) {
+        for (int x = 0; x < length; x++) {
+            alpha[y * length + x] = shape_data[y * shape_stride + x] / 255.0;
+        }
+    }
+    cairo_surface_destroy(shape);
+
+    /** Three box blurs in a row are close enough to a gaussian blur */
+    int box = std::max(radius / 3, 1);
+    auto box_blur = [&] (bool horizontal) {
+        for (int line = 0; line < length; line++) {
+            for (int i = 0; i < length; i++) {
+                float sum = 0;
+                for (int j = std::max(i - box, 0);
+                     j <= std::min(i + box, length - 1); j++) {
+                    sum += horizontal ? alpha[line * length + j] :
+                        alpha[j * length + line];
+                }
+                (horizontal ? blurred[line * length + i] :
+                 blurred[i * length + line]) = sum / (2 * box + 1);
+            }
+        }
+        std::swap(alpha, blurred);
+    };
+    for (int pass = 0; (radius > 0) && (pass < 3); pass++) {
+        box_blur(true);
+        box_blur(false);
+    }
+
+    /** The frame itself is cut out, it is drawn over the shadow anyway */
+    auto *frame = form_mask(margin, c_r);
+    auto *frame_data = cairo_image_surface_get_data(frame);
+    int frame_stride = cairo_image_surface_get_stride(frame);
+
+    auto c = shadow_color.get_value();
+    auto *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, length, length);
+    auto *data = (uint32_t*)cairo_image_surface_get_data(surface);
+    int stride = cairo_image_surface_get_stride(surface) / 4;
+    for (int y = 0; y < length; y++) {
+        for (int x = 0; x < length; x++) {
+            double a = alpha[y * length + x] * c.a *
+                (1.0 - frame_data[y * frame_stride + x] / 255.0);
+            /** Premultiplied, as cairo expects */
+            data[y * stride + x] = ((uint32_t)std::round(a * 255) << 24) |
+                ((uint32_t)std::round(c.r * a * 255) << 16) |
+                ((uint32_t)std::round(c.g * a * 255) << 8) |
+                (uint32_t)std::round(c.b * a * 255);
+        }
+    }
+    cairo_surface_destroy(frame);
+    cairo_surface_mark_dirty(surface);
+
+    return surface;
+}
+
+std::shared_ptr<shadow_image_t> decoration_theme_t::get_shadow(double scale) const {
+    if (get_shadow_margin() <= 0) {
+        return nullptr;
+    }
+
+    /** Everything form_shadow() depends on */
+    using key_t = std::tuple<int, int, std::array<double, 4>, int, uint32_t, double>;
+    static std::map<key_t, std::weak_ptr<shadow_image_t>> cache;
+
+    auto c = shadow_color.get_value();
+    key_t key = { shadow_radius.get_value(), shadow_spread.get_value(),
+                  { c.r, c.g, c.b, c.a }, corner_radius.get_value(),
+                  get_round_on(), scale };
+
+    std::erase_if(cache, [](const auto& entry) { return entry.second.expired(); });
+
+    if (auto it = cache.find(key); it != cache.end()) {
+        return it->second.lock();
+    }
+
+    auto image = std::make_shared<shadow_image_t>();
+    image->margin = get_shadow_margin();
+    image->inset  = std::max(corner_radius.get_value(), 1);
+    image->surf   = form_shadow(scale);
+    image->tex.upload(image->surf);
+    cache[key] = image;
+
+    return image;
+}
+
+border_image_t::~border_image_t() {
+    if (surf) {
+        cairo_surface_destroy(surf);
+    }
+}
+
+cairo_surface_t *decoration_theme_t::form_border_image(double scale) const {
+    std::string path = border_image.get_value();
+    if (path.rfind("~/", 0) == 0) {
+        path = (std::string)getenv("HOME") + path.substr(1);
+    }
+    if (!exists(path)) {
+        return nullptr;
+    }
+
+    if (path.ends_with(".png")) {
+        auto surface = cairo_image_surface_create_from_png(path.c_str());
+        if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+            cairo_surface_destroy(surface);
+            return nullptr;
+        }
+        return surface;
+    } else if (path.ends_with(".svg")) {
+        GFile *file = g_file_new_for_path(path.c_str());
+        RsvgHandle *svg = rsvg_handle_new_from_gfile_sync(file, RSVG_HANDLE_FLAGS_NONE,
+                                                          NULL, NULL);
+        g_object_unref(file);
+        if (!svg) {
+            return nullptr;
+        }
+
+        double width, height;
+        if (!rsvg_handle_get_intrinsic_size_in_pixels(svg, &width, &height)) {
+            g_object_unref(svg);
+            return nullptr;
+        }
+
+        auto surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                                  std::ceil(width * scale),
+                                                  std::ceil(height * scale));
+        auto cr = cairo_create(surface);
+        RsvgRectangle rect { 0, 0, width * scale, height * scale };
+        rsvg_handle_render_document(svg, cr, &rect, nullptr);
+        cairo_destroy(cr);
+        g_object_unref(svg);
+
+        return surface;
+    }
+
+    return nullptr;
+}
+
+std::shared_ptr<border_image_t> decoration_theme_t::get_border_image(double scale) const {
+    if (!has_border_image()) {
+        return nullptr;
+    }
+
+    /** Everything form_border_image() depends on, and the slices */
+    using key_t = std::tuple<std::string, double, int, int, int, int>;
+    static std::map<key_t, std::weak_ptr<border_image_t>> cache;
+
+    key_t key = { border_image.get_value(), scale, border_slice.top,
+                  border_slice.left, border_slice.bottom, border_slice.right };
+
+    std::erase_if(cache, [](const auto& entry) { return entry.second.expired(); });
+
+    if (auto it = cache.find(key); it != cache.end()) {
+        return it->second.lock();
+    }
+
+    auto *surface = form_border_image(scale);
+    if (!surface) {
+        return nullptr;
+    }
+
+    /** Svg images are rasterized to the scale, so their slices grow with it */
+    double slice_scale = border_image.get_value().ends_with(".svg") ? scale : 1.0;
+    int width  = cairo_image_surface_get_width(surface);
+    int height = cairo_image_surface_get_height(surface);
+    auto scaled = [&] (int inset, int length) {
+        return std::clamp((int)std::round(inset * slice_scale), 0, length / 2);
+    };
+
+    auto image = std::make_shared<border_image_t>();
+    image->surf  = surface;
+    image->slice = {
+        scaled(border_slice.top, height), scaled(border_slice.left, width),
+        scaled(border_slice.bottom, height), scaled(border_slice.right, width)
+    };
+    image->tex.upload(image->surf);
+    cache[key] = image;
+
+    return image;
+}
+
 cairo_surface_t *decoration_theme_t::form_button(button_type_t button, double hover,
-                                                 bool active, bool maximized) const {
+                                                 bool active, bool maximized,
+                                                 double scale) const {
+    int size = ceil(button_size.get_value() * scale);
+
 	if ((std::string)button_style.get_value() != "wayfire" &&
 		(std::string)button_style.get_value() != "firedecor" &&
 	    (std::string)button_style.get_value() != "simple") {
@@ -252,16 +606,18 @@ cairo_surface_t *decoration_theme_t::form_button(button_type_t button, double ho
             assert(false);
         }
         if (auto full_path = path + "png"; exists(full_path)) {
-            return surface_png(full_path, button_size.get_value());
+            return surface_png(full_path, size);
         } else if (auto full_path = path + "svg"; exists(full_path)) {
-            return surface_svg(full_path, button_size.get_value());
+            return surface_svg(full_path, size);
         }
 	}
 
     cairo_surface_t *button_surface = cairo_image_surface_create(
-        CAIRO_FORMAT_ARGB32, button_size.get_value(), button_size.get_value());
+        CAIRO_FORMAT_ARGB32, size, size);
 
+    /** Everything below is drawn in logical pixels */
     auto cr = cairo_create(button_surface);
+    cairo_scale(cr, scale, scale);
     cairo_set_antialias(cr, CAIRO_ANTIALIAS_BEST);
 
     /* Clear the button background */
@@ -492,6 +848,12 @@ cairo_surface_t * decoration_theme_t::surface_png(std::string path, int size) co
     cairo_translate(cr, -(double)size / 2, -(double)size / 2);
 
     cairo_set_source_surface(cr, image, (size - width) / 2, (size - height) / 2);
+    /** The full tier keeps the default filter, which icons were always drawn with */
+    if (quality_tier == QUALITY_FAST) {
+        cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_NEAREST);
+    } else if (quality_tier == QUALITY_BALANCED) {
+        cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_GOOD);
+    }
     cairo_paint(cr);
     cairo_surface_destroy(image);
     cairo_destroy(cr);
@@ -530,7 +892,9 @@ std::string get_from_desktop(std::string path, std::string var) {
 	}
 }
 
-cairo_surface_t *decoration_theme_t::form_icon(std::string app_id) const {
+cairo_surface_t *decoration_theme_t::form_icon(std::string app_id,
+                                               double scale) const {
+    int size = ceil(icon_size.get_value() * scale);
 	std::string line;
 	std::string icons = (std::string)getenv("HOME") + "/.local/share/firedecor_icons";
 	std::ofstream icon_file_out(icons, std::ofstream::out | std::ofstream::app);
@@ -546,9 +910,9 @@ cairo_surface_t *decoration_theme_t::form_icon(std::string app_id) const {
 			if (line.find(app_id + " ") == 0) {
 				std::string path = line.substr(line.find(' ') + 1);
 				if (line.rfind(".svg") != std::string::npos) {
-					return surface_svg(path, icon_size.get_value());
+					return surface_svg(path, size);
 				} else if (line.rfind(".png") != std::string::npos) {
-    				return surface_png(path, icon_size.get_value());
+    				return surface_png(path, size);
 				}
 			}
 		}
@@ -1,6 +1,9 @@
 #pragma once
+#include <memory>
+#include <pango/pango.h>
 #include <wayfire/render-manager.hpp>
 
+#include "firedecor-atlas.hpp"
 #include "firedecor-buttons.hpp"
 
 namespace wf {
@@ -35,6 +38,25 @@ enum edge_t {
 	EDGE_RIGHT  = 3
 };
 
+/** The corners of the decoration that can be rounded */
+enum corner_bits_t : uint32_t {
+	CORNER_TR  = (1 << 0),
+	CORNER_TL  = (1 << 1),
+	CORNER_BL  = (1 << 2),
+	CORNER_BR  = (1 << 3),
+	CORNER_ALL = CORNER_TR | CORNER_TL | CORNER_BL | CORNER_BR
+};
+
+/** How much looks are traded for frame time */
+enum quality_t {
+	/** Square corners, flat accents, no hover animations, nearest icon scaling */
+	QUALITY_FAST     = 0,
+	/** Every shape, but no hover animations and cheaper icon scaling */
+	QUALITY_BALANCED = 1,
+	/** Everything */
+	QUALITY_FULL     = 2
+};
+
 /**
  * Checks if a file exists in storage
  * @param path The path of the file to find
@@ -60,6 +82,62 @@ std::vector<std::string> get_desktops(std::string path);
  */
 std::string get_from_desktop(std::string path, std::string var);
 
+/**
+ * A top right corner, for active and inactive windows, shared by every
+ * decoration whose theme draws the same corner. The other corners are mirror
+ * images of it, so they are produced by flipping it at draw time.
+ */
+struct corner_image_t {
+    cairo_surface_t *surf[2] = { nullptr, nullptr };
+    atlas_texture_t tex[2];
+
+    corner_image_t() = default;
+    ~corner_image_t();
+
+    corner_image_t(const corner_image_t &) = delete;
+    corner_image_t(corner_image_t &&) = delete;
+    corner_image_t& operator =(const corner_image_t&) = delete;
+    corner_image_t& operator =(corner_image_t&&) = delete;
+};
+
+/** An image stretched over the border, shared by every decoration whose theme uses it */
+struct border_image_t {
+    cairo_surface_t *surf = nullptr;
+    atlas_texture_t tex;
+    /** The sizes of the edges of the image, in the pixels of surf */
+    slice_insets_t slice;
+
+    border_image_t() = default;
+    ~border_image_t();
+
+    border_image_t(const border_image_t &) = delete;
+    border_image_t(border_image_t &&) = delete;
+    border_image_t& operator =(const border_image_t&) = delete;
+    border_image_t& operator =(border_image_t&&) = delete;
+};
+
+/**
+ * A blurred shadow around a small frame, shared by every decoration whose theme
+ * casts the same shadow. It is cut in nine slices, the corners are drawn as they
+ * are and the edges are stretched along the decoration.
+ */
+struct shadow_image_t {
+    cairo_surface_t *surf = nullptr;
+    atlas_texture_t tex;
+    /** How far the shadow extends past the frame, in logical pixels */
+    int margin;
+    /** How far the corner slices go into the frame, in logical pixels */
+    int inset;
+
+    shadow_image_t() = default;
+    ~shadow_image_t();
+
+    shadow_image_t(const shadow_image_t &) = delete;
+    shadow_image_t(shadow_image_t &&) = delete;
+    shadow_image_t& operator =(const shadow_image_t&) = delete;
+    shadow_image_t& operator =(shadow_image_t&&) = delete;
+};
+
 template<typename T>
 struct theme_option_t {
   public:
@@ -86,6 +164,8 @@ struct theme_options {
     theme_option_t<wf::color_t> active_border;
     theme_option_t<wf::color_t> inactive_border;
     theme_option_t<int> corner_radius;
+    theme_option_t<std::string> border_image;
+    theme_option_t<std::string> border_image_slice;
 
     theme_option_t<int> outline_size;
     theme_option_t<wf::color_t> active_outline;
@@ -107,12 +187,17 @@ struct theme_options {
     theme_option_t<wf::color_t> active_accent;
     theme_option_t<wf::color_t> inactive_accent;
 
+    theme_option_t<int> shadow_radius;
+    theme_option_t<int> shadow_spread;
+    theme_option_t<wf::color_t> shadow_color;
+
 	theme_option_t<int> padding_size;
     theme_option_t<std::string> layout;
 
 	theme_option_t<std::string> ignore_views;
     theme_option_t<bool> debug_mode;
     theme_option_t<std::string> round_on;
+    theme_option_t<std::string> quality;
 };
 
 class decoration_theme_t : private theme_options {
@@ -155,8 +240,14 @@ class decoration_theme_t : private theme_options {
 	bool has_title_orientation(orientation_t orientation) const;
 	/** @return True if debug_mode is on */
 	bool get_debug_mode() const;
-	/** @return Where corners should be drawn */
-	std::string get_round_on() const;
+	/** @return The corner_bits_t of the corners that should be rounded */
+	uint32_t get_round_on() const;
+	/** @return How far the shadow extends past the decoration, 0 if none */
+	int get_shadow_margin() const;
+	/** @return True if the border is drawn from an image */
+	bool has_border_image() const;
+	/** @return The quality tier of the theme */
+	quality_t get_quality() const;
 
 	/**
      * Get what the title size should be, given a text for the title, useful for
@@ -164,33 +255,85 @@ class decoration_theme_t : private theme_options {
      */
 	wf::dimensions_t get_text_size(std::string title, int width) const;
 
+	/**
+     * Same as above, measured with a pango context of the calling thread, so it
+     * can be used off the main thread.
+     */
+	wf::dimensions_t get_text_size(const std::string& title,
+	                               PangoContext *context) const;
+
     /**
      * Render the given text on a cairo_surface_t with the given size.
      * The caller is responsible for freeing the memory afterwards.
+     * @param title_size The size of the surface, in pixels.
+     * @param scale The scale of the framebuffer, which the font is scaled by.
      */
     cairo_surface_t *form_title(std::string text, wf::dimensions_t title_size,
-                                bool active, orientation_t orientation) const;
+                                bool active, orientation_t orientation,
+                                double scale) const;
 
     /**
      * Render the corners for active and inactive windows. 
      * @param active The activation state of the window.
      * @param r the radius of the corner.
-     * @param scale The scale of the framebuffer.
-     * @param m The matrix to transform the corner.
+     * @param m The matrix to transform the corner, scaled by the scale of the
+     * framebuffer.
      * @param height The height of the corner, set by radius or the border size.
      */
     cairo_surface_t *form_corner(bool active, int r, matrix<double> m, 
                                  int height) const;
 
+    /**
+     * Get the top right corner for active and inactive windows, rasterizing it
+     * only if no other decoration has one with the same looks.
+     * @param r the radius of the corner, or 0 for a flat corner.
+     * @param height The height of the corner, set by radius or the border size.
+     * @param scale The scale of the framebuffer.
+     */
+    std::shared_ptr<corner_image_t> get_corner(int r, int height,
+                                               double scale) const;
+
+    /**
+     * Render the shadow of a frame just big enough for its corners, and cut
+     * out the frame itself, so translucent decorations don't darken.
+     * @param scale The scale of the framebuffer.
+     */
+    cairo_surface_t *form_shadow(double scale) const;
+
+    /**
+     * Get the shadow, blurring it only if no other decoration has one with the
+     * same looks.
+     * @param scale The scale of the framebuffer.
+     * @return The shadow, or nullptr if the theme has no shadows.
+     */
+    std::shared_ptr<shadow_image_t> get_shadow(double scale) const;
+
+    /**
+     * Load the border image, rasterizing svg images to the scale.
+     * The caller is responsible for freeing the memory afterwards.
+     * @param scale The scale of the framebuffer.
+     * @return The image, or nullptr if it couldn't be loaded.
+     */
+    cairo_surface_t *form_border_image(double scale) const;
+
+    /**
+     * Get the border image, loading it only if no other decoration uses it
+     * with the same scale.
+     * @param scale The scale of the framebuffer.
+     * @return The image, or nullptr if the theme has none.
+     */
+    std::shared_ptr<border_image_t> get_border_image(double scale) const;
+
     /**
      * Get the icon for the given button.
      * The caller is responsible for freeing the memory afterwards.
      *
      * @param button The button type.
      * @param state The button state.
+     * @param scale The scale of the framebuffer.
      */
     cairo_surface_t *form_button(button_type_t button, double hover,
-                                 bool active, bool maximized) const;
+                                 bool active, bool maximized, double scale) const;
 
 	/**
 	 * Gets a cairo surface with an svg texture.
@@ -206,8 +349,17 @@ class decoration_theme_t : private theme_options {
     /**
      * Get the icon for the given application icon.
      * @param title The icon for the window.
+     * @param scale The scale of the framebuffer.
      */
-    cairo_surface_t *form_icon(std::string app_id) const;
+    cairo_surface_t *form_icon(std::string app_id, double scale) const;
+
+  private:
+	/** round_on, parsed once when the theme is created */
+	uint32_t round_on_bits;
+	/** border_image_slice, parsed once when the theme is created */
+	slice_insets_t border_slice;
+	/** quality, parsed once when the theme is created */
+	quality_t quality_tier;
 };
 }
 }
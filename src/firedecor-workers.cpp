@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <pango/pangocairo.h>
+
+#include "firedecor-workers.hpp"
+
+namespace wf {
+namespace firedecor {
+std::shared_ptr<text_workers_t> text_workers_t::get() {
+    static std::weak_ptr<text_workers_t> instance;
+
+    auto workers = instance.lock();
+    if (!workers) {
+        workers = std::make_shared<text_workers_t>();
+        instance = workers;
+    }
+
+    return workers;
+}
+
+/**
+ * @return A context that measures text the same way as the layouts made by
+ * pango_cairo_create_layout() on an image surface.
+ */
+static PangoContext *create_context(PangoFontMap *font_map) {
+    auto *context = pango_font_map_create_context(font_map);
+    auto *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
+    auto *cr = cairo_create(surface);
+    pango_cairo_update_context(cr, context);
+    cairo_destroy(cr);
+    cairo_surface_destroy(surface);
+
+    return context;
+}
+
+text_workers_t::~text_workers_t() {
+    {
+        std::lock_guard lock{mutex};
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (context) {
+        g_object_unref(context);
+        g_object_unref(font_map);
+    }
+}
+
+void text_workers_t::take_items(PangoContext *context) {
+    for (size_t i; (i = next++) < count;) {
+        (*job)(i, context);
+    }
+}
+
+void text_workers_t::work(uint64_t seen) {
+    auto *font_map = pango_cairo_font_map_new();
+    auto *context  = create_context(font_map);
+
+    while (true) {
+        {
+            std::unique_lock lock{mutex};
+            wake.wait(lock, [&] { return stopping || (generation != seen); });
+            if (stopping) {
+                break;
+            }
+            seen = generation;
+        }
+
+        take_items(context);
+
+        std::lock_guard lock{mutex};
+        if (--running == 0) {
+            finished.notify_one();
+        }
+    }
+
+    g_object_unref(context);
+    g_object_unref(font_map);
+}
+
+void text_workers_t::run(size_t count, const job_t& job) {
+    if (!context) {
+        font_map = pango_cairo_font_map_new();
+        context  = create_context(font_map);
+    }
+
+    /** Small jobs are done right here, without waking anyone */
+    size_t wanted = std::min<size_t>(std::thread::hardware_concurrency(),
+                                     count / TEXT_ITEMS_PER_THREAD);
+    if (wanted <= 1) {
+        for (size_t i = 0; i < count; i++) {
+            job(i, context);
+        }
+        return;
+    }
+
+    /** This thread is one of the wanted ones */
+    while (threads.size() + 1 < wanted) {
+        threads.emplace_back([this, seen = generation] () { work(seen); });
+    }
+
+    {
+        std::lock_guard lock{mutex};
+        this->job   = &job;
+        this->count = count;
+        this->next  = 0;
+        running = threads.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    take_items(context);
+
+    std::unique_lock lock{mutex};
+    finished.wait(lock, [&] { return running == 0; });
+    this->job = nullptr;
+}
+}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <pango/pango.h>
+
+namespace wf {
+namespace firedecor {
+
+/** Fewer items than this per thread are not worth waking another thread for */
+static constexpr size_t TEXT_ITEMS_PER_THREAD = 8;
+
+/**
+ * Threads that measure text for relayouts, kept alive between them. They are
+ * started the first time a relayout is large enough to be split, and sleep
+ * until the next one.
+ *
+ * Pango font maps aren't thread safe, so every thread, the calling one
+ * included, measures with a font map and a context of its own, made once.
+ */
+class text_workers_t {
+  public:
+    /** Measures the item of an index, with the context of the calling thread */
+    using job_t = std::function<void(size_t, PangoContext*)>;
+
+    /** @return The workers shared by every output, created on demand */
+    static std::shared_ptr<text_workers_t> get();
+
+    text_workers_t() = default;
+    ~text_workers_t();
+
+    text_workers_t(const text_workers_t &) = delete;
+    text_workers_t(text_workers_t &&) = delete;
+    text_workers_t& operator =(const text_workers_t&) = delete;
+    text_workers_t& operator =(text_workers_t&&) = delete;
+
+    /**
+     * Call the job for every index below count, spread over the workers and
+     * the calling thread, which must be the main one.
+     * Returns once every index is done.
+     */
+    void run(size_t count, const job_t& job);
+
+  private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+
+    /** The job being run, its amount of items, and the next one to take */
+    const job_t *job = nullptr;
+    size_t count = 0;
+    std::atomic<size_t> next = 0;
+
+    /** Increased for every job, so sleeping workers know there is a new one */
+    uint64_t generation = 0;
+    /** Workers that haven't finished the current job yet */
+    size_t running = 0;
+    bool stopping = false;
+
+    /** The pango objects of the main thread */
+    PangoFontMap *font_map = nullptr;
+    PangoContext *context  = nullptr;
+
+    /** The loop of a worker, which starts after the given job */
+    void work(uint64_t seen);
+
+    /** Take items of the current job until none are left */
+    void take_items(PangoContext *context);
+};
+}
+}
@@ -4,10 +4,16 @@
 #include <wayfire/workspace-manager.hpp>
 #include <wayfire/output.hpp>
 #include <wayfire/signal-definitions.hpp>
+#include <wayfire/util.hpp>
+#include <wayfire/util/log.hpp>
 
 #include "firedecor-subsurface.hpp"
+#include "firedecor-workers.hpp"
 
 namespace {
+/** How often the upload statistics are logged in debug mode, in milliseconds */
+constexpr uint32_t UPLOAD_STATS_INTERVAL = 5000;
+
 struct wayfire_decoration_global_cleanup_t {
     wayfire_decoration_global_cleanup_t() = default;
     ~wayfire_decoration_global_cleanup_t() {
@@ -32,13 +38,79 @@ class wayfire_firedecor_t :
     wf::view_matcher_t ignore_views{"firedecor/ignore_views"};
     wf::option_wrapper_t<std::string> extra_themes{"firedecor/extra_themes"};
 
+    /** Draws the decorations of every view decorated by this output */
+    std::shared_ptr<wf::firedecor::decoration_renderer_t> renderer =
+        std::make_shared<wf::firedecor::decoration_renderer_t>();
+
+    wf::option_wrapper_t<bool> batched_rendering{"firedecor/batched_rendering"};
+
+    /** Textures recycled between the decorations of every output */
+    std::shared_ptr<wf::firedecor::texture_pool_t> texture_pool =
+        wf::firedecor::texture_pool_t::get();
+
+    /** Threads measuring titles in relayouts, shared between every output */
+    std::shared_ptr<wf::firedecor::text_workers_t> text_workers =
+        wf::firedecor::text_workers_t::get();
+
     wf::signal_connection_t view_updated{ [=] (wf::signal_data_t *data) {
 	        update_view_decoration(get_signaled_view(data));
 	    }
     };
 
+    /**
+     * Themes are read when decorations are created, so they are all created
+     * again, and their titles measured in one batch.
+     */
+    wf::signal_connection_t config_reloaded{ [=] (wf::signal_data_t *data) {
+            auto views = output->workspace->get_views_in_layer(wf::ALL_LAYERS);
+
+            /** Activated once for the whole batch, rather than once per view */
+            bool active = output->activate_plugin(grab_interface);
+            for (auto& view : views) {
+                if (!wants_decoration(view)) {
+                    wf::firedecor::deinit_view(view);
+                } else if (active) {
+                    decorate_view(view);
+                }
+            }
+            if (active) {
+                output->deactivate_plugin(grab_interface);
+            }
+
+            wf::firedecor::relayout_views(views);
+        }
+    };
+
+    /** Titles are measured again, in one batch, when the output is rescaled */
+    wf::signal_connection_t output_configuration_changed{ [=] (wf::signal_data_t *data) {
+            auto ev = static_cast<wf::output_configuration_changed_signal*>(data);
+            if (ev->changed_fields & wf::OUTPUT_SCALE_CHANGE) {
+                wf::firedecor::relayout_views(
+                    output->workspace->get_views_in_layer(wf::ALL_LAYERS));
+            }
+        }
+    };
+
     wf::config::config_manager_t& config = wf::get_core().config;
 
+    wf::option_wrapper_t<bool> debug_mode{"firedecor/debug_mode"};
+
+    /** Logs the upload statistics of the atlas while debugging */
+    wf::wl_timer upload_stats_timer;
+
+    /** The statistics are shared, so only one output logs them */
+    static inline wayfire_firedecor_t *stats_logger = nullptr;
+
+    bool log_upload_stats() {
+        if (debug_mode) {
+            auto stats = wf::firedecor::texture_atlas_t::get()->get_upload_stats();
+            LOGI("firedecor: uploaded ", stats.bytes_per_second / 1024,
+                 " KiB/s, ", stats.total_bytes / 1024, " KiB in total");
+        }
+
+        return true;
+    }
+
   public:
 
     void init() override {
@@ -47,9 +119,24 @@ class wayfire_firedecor_t :
 
         output->connect_signal("view-mapped", &view_updated);
         output->connect_signal("view-decoration-state-updated", &view_updated);
+        output->connect_signal("output-configuration-changed",
+                               &output_configuration_changed);
+        wf::get_core().connect_signal("reload-config", &config_reloaded);
+
+        renderer->set_batched(batched_rendering);
+        batched_rendering.set_callback([=] () {
+            renderer->set_batched(batched_rendering);
+        });
         for (auto& view : output->workspace->get_views_in_layer(wf::ALL_LAYERS)) {
             update_view_decoration(view);
         }
+
+        if (!stats_logger) {
+            stats_logger = this;
+            upload_stats_timer.set_timeout(UPLOAD_STATS_INTERVAL, [=] () {
+                return log_upload_stats();
+            });
+        }
     }
 
     wf::wl_idle_call idle_deactivate;
@@ -77,6 +164,8 @@ class wayfire_firedecor_t :
             get_option<wf::color_t>(theme, "active_border"),
             get_option<wf::color_t>(theme, "inactive_border"),
             get_option<int>(theme, "corner_radius"),
+            get_option<std::string>(theme, "border_image"),
+            get_option<std::string>(theme, "border_image_slice"),
 
             get_option<int>(theme, "outline_size"),
             get_option<wf::color_t>(theme, "active_outline"),
@@ -98,35 +187,50 @@ class wayfire_firedecor_t :
             get_option<wf::color_t>(theme, "active_accent"),
             get_option<wf::color_t>(theme, "inactive_accent"),
 
+            get_option<int>(theme, "shadow_radius"),
+            get_option<int>(theme, "shadow_spread"),
+            get_option<wf::color_t>(theme, "shadow_color"),
+
         	get_option<int>(theme, "padding_size"),
             get_option<std::string>(theme, "layout"),
 
         	get_option<std::string>(theme, "ignore_views"),
             get_option<bool>(theme, "debug_mode"),
-            get_option<std::string>(theme, "round_on")
+            get_option<std::string>(theme, "round_on"),
+            get_option<std::string>(theme, "quality")
         };
         return options;
     }
 
+    /** @return True if the view should be decorated, and isn't ignored */
+    bool wants_decoration(wayfire_view view) {
+        return view->should_be_decorated() && !ignore_views.matches(view);
+    }
+
+    /** Decorate the view with the first theme it matches, the plugin being active */
+    void decorate_view(wayfire_view view) {
+	    std::stringstream themes{extra_themes.value()};
+	    std::string theme;
+	    while (themes >> theme) {
+		    try {
+			    wf::view_matcher_t matcher{theme + "/uses_if"};
+			    if (matcher.matches(view)) {
+				    wf::firedecor::init_view(view, get_options(theme), renderer);
+				    return;
+			    }
+		    } catch (...) {
+		    }
+	    }
+	    wf::firedecor::init_view(view, get_options("invalid"), renderer);
+    }
+
     void update_view_decoration(wayfire_view view) {
-	    if (view->should_be_decorated() && !ignore_views.matches(view)) {
+	    if (wants_decoration(view)) {
 		    if (output->activate_plugin(grab_interface)) {
 			    idle_deactivate.run_once([this] () {
 				    output->deactivate_plugin(grab_interface);
 			    });
-    		    std::stringstream themes{extra_themes.value()};
-    		    std::string theme;
-    		    while (themes >> theme) {
-        		    try {
-            		    wf::view_matcher_t matcher{theme + "/uses_if"};
-            		    if (matcher.matches(view)) {
-                		    wf::firedecor::init_view(view, get_options(theme));
-                		    return;
-            		    }
-         		    } catch (...) {
-         		    }
-    		    }
-			    wf::firedecor::init_view(view, get_options("invalid"));
+			    decorate_view(view);
 		    }
 	    } else {
 		    wf::firedecor::deinit_view(view);
@@ -134,6 +238,11 @@ class wayfire_firedecor_t :
     }
 
     void fini() override {
+        if (stats_logger == this) {
+            upload_stats_timer.disconnect();
+            stats_logger = nullptr;
+        }
+
         for (auto& view : output->workspace->get_views_in_layer(wf::ALL_LAYERS)) {
             wf::firedecor::deinit_view(view);
         }
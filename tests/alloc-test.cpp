@@ -0,0 +1,146 @@
+/**
+ * Renders decorations over and over, through every path of the renderer, and
+ * checks that nothing is allocated once the storage it keeps between frames
+ * has grown to fit. The decorations are drawn by their painters, the same code
+ * the plugin draws them with, only the compositor beneath them is stubbed.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "firedecor-painter.hpp"
+#include "compositor-stubs.hpp"
+#include "test-themes.hpp"
+
+/** Frames rendered before counting, to let the kept storage grow */
+static constexpr int WARMUP_FRAMES = 10;
+/** Frames rendered while counting */
+static constexpr int COUNTED_FRAMES = 1000;
+
+/** The size of the decorations, the view inside of them included */
+static constexpr wf::dimensions_t DECORATION_SIZE = { 820, 645 };
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+}
+
+/** Calls to malloc(), calloc() and realloc() since the counter was last reset */
+static size_t allocations = 0;
+
+/**
+ * The allocator itself is replaced, rather than operator new, so that pixman,
+ * cairo and the other C libraries are counted as well. operator new ends up
+ * here too.
+ */
+extern "C" void *malloc(size_t size) {
+    allocations++;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) {
+    allocations++;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+    allocations++;
+    return __libc_realloc(ptr, size);
+}
+
+using namespace wf::firedecor;
+
+/** A decoration, set up the way its surface sets it up for a view */
+static std::unique_ptr<decoration_painter_t> make_painter(stubs::theme_kind_t kind,
+    std::shared_ptr<decoration_renderer_t> renderer) {
+    auto painter = std::make_unique<decoration_painter_t>(stubs::make_theme(kind),
+        renderer, [] (wlr_box) {});
+
+    painter->set_title("firedecor allocation test");
+    painter->set_app_id(stubs::app_id);
+    painter->set_view_state(true, 0);
+    painter->update_decoration_size(false);
+    painter->resize(DECORATION_SIZE);
+
+    return painter;
+}
+
+int main() {
+    stubs::setup_home();
+
+    auto gl = std::make_shared<decoration_renderer_t>();
+    stubs::gl_renderer = "llvmpipe";
+    auto software = std::make_shared<decoration_renderer_t>();
+    stubs::gl_renderer = nullptr;
+
+    std::vector<std::unique_ptr<decoration_painter_t>> gl_painters, software_painters;
+    for (auto kind : { stubs::THEME_PLAIN, stubs::THEME_OUTLINE,
+                       stubs::THEME_BORDER_IMAGE }) {
+        gl_painters.push_back(make_painter(kind, gl));
+        software_painters.push_back(make_painter(kind, software));
+    }
+
+    wf::render_target_t fb;
+    fb.geometry = { 0, 0, 1920, 1080 };
+
+    /** The title bar changes on every frame, like a button being hovered */
+    const wf::geometry_t changed = { 600, 0, 220, 35 };
+
+    auto render_frame = [&] () {
+        for (bool batched : { true, false }) {
+            gl->set_batched(batched);
+            for (auto& painter : gl_painters) {
+                painter->render(fb, { 0, 0 }, painter->get_region());
+            }
+        }
+
+        for (auto& painter : software_painters) {
+            painter->damage_box(changed);
+            painter->render(fb, { 0, 0 }, wf::region_t{ changed });
+        }
+    };
+
+    for (int i = 0; i < WARMUP_FRAMES; i++) {
+        render_frame();
+    }
+
+    allocations = 0;
+    stubs::draw_arrays_calls = 0;
+    for (int i = 0; i < COUNTED_FRAMES; i++) {
+        render_frame();
+    }
+    size_t counted = allocations;
+    size_t draws   = stubs::draw_arrays_calls;
+
+    int result = 0;
+    if (counted > 0) {
+        std::fprintf(stderr, "%zu allocations in %d frames\n", counted,
+                     COUNTED_FRAMES);
+        result = 1;
+    }
+
+    /**
+     * Every asset is on the first atlas page, so each scissor box is a single
+     * batched draw. The damage is the whole frame, which is coalesced into at
+     * most one box per box of the frame.
+     */
+    size_t boxes = 0;
+    for (auto& painter : gl_painters) {
+        for (const auto& box : painter->get_region()) {
+            (void)box;
+            boxes++;
+        }
+    }
+
+    /** The software painters draw their strips with the batch too */
+    size_t software_boxes = software_painters.size();
+    if ((draws == 0) || (draws > (size_t)COUNTED_FRAMES * (boxes + software_boxes))) {
+        std::fprintf(stderr, "%zu batched draws in %d frames, expected at most %zu\n",
+                     draws, COUNTED_FRAMES, COUNTED_FRAMES * (boxes + software_boxes));
+        result = 1;
+    }
+
+    return result;
+}
@@ -0,0 +1,383 @@
+/**
+ * The symbols of the compositor and of GL that the decoration's drawing code
+ * uses. Plugins aren't linked against the compositor, they find these in
+ * it once loaded, so tests have to provide them. Nothing is drawn: textures
+ * and buffers only get names, and draws are counted.
+ */
+#include <algorithm>
+#include <utility>
+
+#include <wayfire/core.hpp>
+#include <wayfire/opengl.hpp>
+#include <wayfire/region.hpp>
+#include <wayfire/util.hpp>
+#include <wayfire/util/duration.hpp>
+
+#include "compositor-stubs.hpp"
+
+namespace stubs {
+size_t draw_arrays_calls = 0;
+size_t single_draws = 0;
+const char *gl_renderer = nullptr;
+
+/** The last name given to a texture, buffer or framebuffer */
+static GLuint last_name = 0;
+
+static void generate(GLsizei n, GLuint *names) {
+    for (GLsizei i = 0; i < n; i++) {
+        names[i] = ++last_name;
+    }
+}
+}
+
+/**** GL, without a context */
+const GLubyte *glGetString(GLenum) { return (const GLubyte*)stubs::gl_renderer; }
+void glGetIntegerv(GLenum, GLint *data) { *data = 0; }
+void glGenTextures(GLsizei n, GLuint *textures) { stubs::generate(n, textures); }
+void glGenBuffers(GLsizei n, GLuint *buffers) { stubs::generate(n, buffers); }
+void glGenFramebuffers(GLsizei n, GLuint *fbs) { stubs::generate(n, fbs); }
+void glDeleteTextures(GLsizei, const GLuint*) {}
+void glDeleteBuffers(GLsizei, const GLuint*) {}
+void glDeleteFramebuffers(GLsizei, const GLuint*) {}
+void glActiveTexture(GLenum) {}
+void glBindTexture(GLenum, GLuint) {}
+void glBindBuffer(GLenum, GLuint) {}
+void glBindFramebuffer(GLenum, GLuint) {}
+void glFramebufferTexture2D(GLenum, GLenum, GLenum, GLuint, GLint) {}
+void glTexParameteri(GLenum, GLenum, GLint) {}
+void glPixelStorei(GLenum, GLint) {}
+void glTexImage2D(GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum,
+                  const void*) {}
+void glTexSubImage2D(GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum,
+                     const void*) {}
+void glCopyTexSubImage2D(GLenum, GLint, GLint, GLint, GLint, GLint, GLsizei,
+                         GLsizei) {}
+void glBufferData(GLenum, GLsizeiptr, const void*, GLenum) {}
+void *glMapBufferRange(GLenum, GLintptr, GLsizeiptr, GLbitfield) { return nullptr; }
+GLboolean glUnmapBuffer(GLenum) { return GL_TRUE; }
+void glEnable(GLenum) {}
+void glBlendFunc(GLenum, GLenum) {}
+void glDrawArrays(GLenum, GLint, GLsizei) { stubs::draw_arrays_calls++; }
+/****/
+
+/**** The compositor's GL helpers */
+void gl_call(const char*, uint32_t, const char*) {}
+
+wf::texture_t::texture_t(GLuint tex) {
+    this->tex_id = tex;
+}
+
+glm::mat4 wf::render_target_t::get_orthographic_projection() const {
+    return glm::mat4(1.0);
+}
+
+void wf::render_target_t::logic_scissor(wlr_box) const {}
+
+namespace OpenGL {
+void render_begin() {}
+void render_begin(const wf::framebuffer_base_t&) {}
+void render_end() {}
+
+void render_rectangle(wf::geometry_t, wf::color_t, glm::mat4) {
+    stubs::single_draws++;
+}
+
+void render_transformed_texture(wf::texture_t, const gl_geometry&,
+                                const gl_geometry&, glm::mat4, glm::vec4, uint32_t) {
+    stubs::single_draws++;
+}
+
+class program_t::impl {};
+
+program_t::program_t() = default;
+program_t::~program_t() = default;
+void program_t::compile(const std::string&, const std::string&) {}
+void program_t::free_resources() {}
+void program_t::use(wf::texture_type_t) {}
+void program_t::uniform1i(const std::string&, int) {}
+void program_t::uniformMatrix4f(const std::string&, const glm::mat4&) {}
+void program_t::attrib_pointer(const std::string&, int, int, const void*, GLenum) {}
+void program_t::deactivate() {}
+}
+/****/
+
+/**** Geometry, regions and timers */
+bool wf::operator ==(const wf::dimensions_t& a, const wf::dimensions_t& b) {
+    return (a.width == b.width) && (a.height == b.height);
+}
+
+bool wf::operator !=(const wf::dimensions_t& a, const wf::dimensions_t& b) {
+    return !(a == b);
+}
+
+bool wf::operator ==(const wf::point_t& a, const wf::point_t& b) {
+    return (a.x == b.x) && (a.y == b.y);
+}
+
+bool wf::operator !=(const wf::point_t& a, const wf::point_t& b) {
+    return !(a == b);
+}
+
+bool wf::operator ==(const wf::geometry_t& a, const wf::geometry_t& b) {
+    return (a.x == b.x) && (a.y == b.y) && (a.width == b.width) &&
+           (a.height == b.height);
+}
+
+bool wf::operator !=(const wf::geometry_t& a, const wf::geometry_t& b) {
+    return !(a == b);
+}
+
+wf::point_t wf::operator +(const wf::point_t& a, const wf::point_t& b) {
+    return { a.x + b.x, a.y + b.y };
+}
+
+wf::point_t wf::operator -(const wf::point_t& a, const wf::point_t& b) {
+    return { a.x - b.x, a.y - b.y };
+}
+
+wf::point_t wf::operator -(const wf::point_t& a) {
+    return { -a.x, -a.y };
+}
+
+wf::geometry_t wf::operator +(const wf::geometry_t& a, const wf::point_t& b) {
+    return { a.x + b.x, a.y + b.y, a.width, a.height };
+}
+
+wf::geometry_t wf::operator -(const wf::geometry_t& a, const wf::point_t& b) {
+    return { a.x - b.x, a.y - b.y, a.width, a.height };
+}
+
+bool wf::operator &(const wf::geometry_t& rect, const wf::point_t& point) {
+    return (point.x >= rect.x) && (point.x < rect.x + rect.width) &&
+           (point.y >= rect.y) && (point.y < rect.y + rect.height);
+}
+
+bool wf::operator &(const wf::geometry_t& rect, const wf::pointf_t& point) {
+    return (point.x >= rect.x) && (point.x < rect.x + rect.width) &&
+           (point.y >= rect.y) && (point.y < rect.y + rect.height);
+}
+
+bool wf::operator &(const wf::geometry_t& r1, const wf::geometry_t& r2) {
+    return (r1.x < r2.x + r2.width) && (r2.x < r1.x + r1.width) &&
+           (r1.y < r2.y + r2.height) && (r2.y < r1.y + r1.height);
+}
+
+wf::geometry_t wf::geometry_intersection(const wf::geometry_t& r1,
+                                         const wf::geometry_t& r2) {
+    int x1 = std::max(r1.x, r2.x), y1 = std::max(r1.y, r2.y);
+    int x2 = std::min(r1.x + r1.width, r2.x + r2.width);
+    int y2 = std::min(r1.y + r1.height, r2.y + r2.height);
+    if ((x1 >= x2) || (y1 >= y2)) {
+        return { 0, 0, 0, 0 };
+    }
+
+    return { x1, y1, x2 - x1, y2 - y1 };
+}
+
+wf::region_t::region_t() {
+    pixman_region32_init(&_region);
+}
+
+wf::region_t::region_t(const wlr_box& box) {
+    pixman_region32_init_rect(&_region, box.x, box.y, box.width, box.height);
+}
+
+wf::region_t::region_t(const region_t& other) {
+    pixman_region32_init(&_region);
+    pixman_region32_copy(&_region, &other._region);
+}
+
+wf::region_t::region_t(region_t&& other) {
+    pixman_region32_init(&_region);
+    std::swap(_region, other._region);
+}
+
+wf::region_t& wf::region_t::operator =(const region_t& other) {
+    pixman_region32_copy(&_region, &other._region);
+    return *this;
+}
+
+wf::region_t& wf::region_t::operator =(region_t&& other) {
+    std::swap(_region, other._region);
+    return *this;
+}
+
+wf::region_t::~region_t() {
+    pixman_region32_fini(&_region);
+}
+
+bool wf::region_t::empty() const {
+    return !pixman_region32_not_empty(&_region);
+}
+
+void wf::region_t::clear() {
+    pixman_region32_clear(&_region);
+}
+
+wlr_box wf::region_t::get_extents() const {
+    return wlr_box_from_pixman_box(*pixman_region32_extents(&_region));
+}
+
+bool wf::region_t::contains_point(const wf::point_t& point) const {
+    return pixman_region32_contains_point(&_region, point.x, point.y, nullptr);
+}
+
+wf::region_t wf::region_t::operator +(const wf::point_t& vector) const {
+    region_t result{*this};
+    pixman_region32_translate(&result._region, vector.x, vector.y);
+    return result;
+}
+
+wf::region_t& wf::region_t::operator +=(const wf::point_t& vector) {
+    pixman_region32_translate(&_region, vector.x, vector.y);
+    return *this;
+}
+
+wf::region_t wf::region_t::operator &(const wlr_box& box) const {
+    region_t result;
+    pixman_region32_intersect_rect(&result._region, &_region, box.x, box.y,
+                                   box.width, box.height);
+    return result;
+}
+
+wf::region_t wf::region_t::operator &(const region_t& other) const {
+    region_t result;
+    pixman_region32_intersect(&result._region, &_region, &other._region);
+    return result;
+}
+
+wf::region_t& wf::region_t::operator &=(const wlr_box& box) {
+    pixman_region32_intersect_rect(&_region, &_region, box.x, box.y, box.width,
+                                   box.height);
+    return *this;
+}
+
+wf::region_t& wf::region_t::operator &=(const region_t& other) {
+    pixman_region32_intersect(&_region, &_region, &other._region);
+    return *this;
+}
+
+wf::region_t wf::region_t::operator |(const wlr_box& other) const {
+    region_t result;
+    pixman_region32_union_rect(&result._region, &_region, other.x, other.y,
+                               other.width, other.height);
+    return result;
+}
+
+wf::region_t wf::region_t::operator |(const region_t& other) const {
+    region_t result;
+    pixman_region32_union(&result._region, &_region, &other._region);
+    return result;
+}
+
+wf::region_t& wf::region_t::operator |=(const wlr_box& other) {
+    pixman_region32_union_rect(&_region, &_region, other.x, other.y, other.width,
+                               other.height);
+    return *this;
+}
+
+wf::region_t& wf::region_t::operator |=(const region_t& other) {
+    pixman_region32_union(&_region, &_region, &other._region);
+    return *this;
+}
+
+wf::region_t wf::region_t::operator ^(const wlr_box& box) const {
+    region_t result;
+    region_t sub{box};
+    pixman_region32_subtract(&result._region, &_region, &sub._region);
+    return result;
+}
+
+wf::region_t wf::region_t::operator ^(const region_t& other) const {
+    region_t result;
+    pixman_region32_subtract(&result._region, &_region, &other._region);
+    return result;
+}
+
+wf::region_t& wf::region_t::operator ^=(const wlr_box& box) {
+    region_t sub{box};
+    pixman_region32_subtract(&_region, &_region, &sub._region);
+    return *this;
+}
+
+wf::region_t& wf::region_t::operator ^=(const region_t& other) {
+    pixman_region32_subtract(&_region, &_region, &other._region);
+    return *this;
+}
+
+pixman_region32_t *wf::region_t::to_pixman() {
+    return &_region;
+}
+
+const pixman_box32_t *wf::region_t::begin() const {
+    int n;
+    return pixman_region32_rectangles(const_cast<pixman_region32_t*>(&_region), &n);
+}
+
+const pixman_box32_t *wf::region_t::end() const {
+    int n;
+    auto *boxes =
+        pixman_region32_rectangles(const_cast<pixman_region32_t*>(&_region), &n);
+    return boxes + n;
+}
+
+wlr_box wlr_box_from_pixman_box(const pixman_box32_t& box) {
+    return { box.x1, box.y1, box.x2 - box.x1, box.y2 - box.y1 };
+}
+
+/** Timers never fire, tests end long before the pool would trim itself */
+void wf::wl_timer::set_timeout(uint32_t, callback_t) {}
+void wf::wl_timer::disconnect() {}
+bool wf::wl_timer::is_connected() { return false; }
+wf::wl_timer::~wl_timer() {}
+
+/** Idle calls never run either, what they damage is drawn on the next frame */
+wf::wl_idle_call::wl_idle_call() {}
+wf::wl_idle_call::~wl_idle_call() {}
+void wf::wl_idle_call::run_once(callback_t) {}
+/****/
+
+/**** Animations, which are always over */
+wf::animation::smoothing::smooth_function wf::animation::smoothing::circle =
+    [] (double x) { return x; };
+
+wf::animation::duration_t::duration_t(std::shared_ptr<wf::config::option_t<int>>,
+                                      smoothing::smooth_function) {}
+wf::animation::duration_t::~duration_t() {}
+bool wf::animation::duration_t::running() { return false; }
+
+wf::animation::timed_transition_t::timed_transition_t(const duration_t&, double start,
+                                                      double end)
+  : start{start}, end{end} {}
+
+wf::animation::timed_transition_t::operator double() const {
+    return end;
+}
+
+wf::animation::simple_animation_t::simple_animation_t(
+    std::shared_ptr<wf::config::option_t<int>> length,
+    smoothing::smooth_function smooth)
+  : duration_t{length, smooth}, timed_transition_t{(const duration_t&)*this} {}
+
+void wf::animation::simple_animation_t::animate(double start, double end) {
+    timed_transition_t::start = start;
+    timed_transition_t::end   = end;
+}
+
+void wf::animation::simple_animation_t::animate(double end) {
+    animate(timed_transition_t::end, end);
+}
+/****/
+
+/**** The core, without a seat */
+namespace stubs {
+class core_t : public wf::compositor_core_t {
+    void set_cursor(std::string) override {}
+};
+}
+
+wf::compositor_core_t& wf::get_core() {
+    static stubs::core_t core;
+    return core;
+}
+/****/
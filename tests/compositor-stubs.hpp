@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+
+namespace stubs {
+/** Calls to glDrawArrays() since the counter was last reset */
+extern size_t draw_arrays_calls;
+
+/** Calls to OpenGL::render_rectangle() and render_transformed_texture() */
+extern size_t single_draws;
+
+/** What glGetString(GL_RENDERER) returns, "llvmpipe" to get the software path */
+extern const char *gl_renderer;
+}
@@ -0,0 +1,55 @@
+/**
+ * Checks the region of the frame, where decorations draw and take input, at
+ * the corners. Rounded corners give up the square outside of their arc, unless
+ * a border image is drawn into them.
+ */
+#include <cstdio>
+
+#include "firedecor-painter.hpp"
+#include "test-themes.hpp"
+
+/** The size of the decorations, the view inside of them included */
+static constexpr wf::dimensions_t DECORATION_SIZE = { 820, 645 };
+
+using namespace wf::firedecor;
+
+/**
+ * Check whether the outermost pixel of every corner is in the region.
+ * @return The number of corners that weren't as expected.
+ */
+static int check_corners(const char *name, stubs::theme_kind_t kind, bool expected) {
+    auto renderer = std::make_shared<decoration_renderer_t>();
+    decoration_painter_t painter{stubs::make_theme(kind), renderer, [] (wlr_box) {}};
+    painter.set_app_id(stubs::app_id);
+    painter.update_decoration_size(false);
+    painter.resize(DECORATION_SIZE);
+
+    const wf::point_t corners[4] = {
+        { 0, 0 }, { DECORATION_SIZE.width - 1, 0 },
+        { 0, DECORATION_SIZE.height - 1 },
+        { DECORATION_SIZE.width - 1, DECORATION_SIZE.height - 1 },
+    };
+
+    int failures = 0;
+    for (const auto& corner : corners) {
+        if (painter.get_region().contains_point(corner) != expected) {
+            std::fprintf(stderr, "%s: corner %d,%d is%s in the region\n", name,
+                         corner.x, corner.y, expected ? " not" : "");
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+int main() {
+    stubs::setup_home();
+
+    int failures = 0;
+    failures += check_corners("rounded", stubs::THEME_PLAIN, false);
+    failures += check_corners("rounded with outline", stubs::THEME_OUTLINE, false);
+    failures += check_corners("rounded with border image", stubs::THEME_BORDER_IMAGE,
+                              true);
+
+    return failures ? 1 : 0;
+}
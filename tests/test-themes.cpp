@@ -0,0 +1,85 @@
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include <cairo.h>
+
+#include "test-themes.hpp"
+
+namespace stubs {
+const char *app_id = "firedecor-test";
+
+/** Write a png of a solid color, which stands in for icons and border images */
+static void write_png(const std::string& path, int width, int height) {
+    auto *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+    auto *cr = cairo_create(surface);
+    cairo_set_source_rgba(cr, 0.2, 0.4, 0.6, 1.0);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+
+    cairo_surface_write_to_png(surface, path.c_str());
+    cairo_surface_destroy(surface);
+}
+
+void setup_home() {
+    char dir[] = "/tmp/firedecor-test-XXXXXX";
+    std::string home = mkdtemp(dir);
+    setenv("HOME", home.c_str(), 1);
+
+    /** Icons that were found before are read from this cache first */
+    std::string share = home + "/.local/share";
+    std::filesystem::create_directories(share);
+
+    write_png(home + "/icon.png", 48, 48);
+    std::ofstream cache(share + "/firedecor_icons");
+    cache << app_id << " " << home << "/icon.png" << std::endl;
+
+    write_png(home + "/border.png", 30, 30);
+}
+
+wf::firedecor::theme_options make_theme(theme_kind_t kind) {
+    wf::color_t dark   = { 0.114, 0.122, 0.129, 0.9 };
+    wf::color_t black  = { 0.0, 0.0, 0.0, 1.0 };
+    wf::color_t accent = { 0.961, 0.961, 0.961, 1.0 };
+
+    return {
+        .font = { "sans-serif" },
+        .font_size = { 21 },
+        .active_title = { dark },
+        .inactive_title = { dark },
+        .max_title_size = { 750 },
+        .border_size = { "35 10" },
+        .active_border = { dark },
+        .inactive_border = { dark },
+        .corner_radius = { 15 },
+        .border_image = { (kind == THEME_BORDER_IMAGE) ? "~/border.png" : "none" },
+        .border_image_slice = { (kind == THEME_BORDER_IMAGE) ? "10" : "0" },
+        .outline_size = { (kind == THEME_OUTLINE) ? 2 : 0 },
+        .active_outline = { black },
+        .inactive_outline = { black },
+        .button_size = { 18 },
+        .button_style = { "simple" },
+        .normal_min = { wf::color_t{ 0.784, 0.620, 0.169, 1.0 } },
+        .hovered_min = { wf::color_t{ 1.0, 0.894, 0.314, 1.0 } },
+        .normal_max = { wf::color_t{ 0.180, 0.733, 0.227, 1.0 } },
+        .hovered_max = { wf::color_t{ 0.376, 0.988, 0.475, 1.0 } },
+        .normal_close = { wf::color_t{ 0.761, 0.251, 0.271, 1.0 } },
+        .hovered_close = { wf::color_t{ 1.0, 0.396, 0.447, 1.0 } },
+        .inactive_buttons = { false },
+        .icon_size = { 20 },
+        .icon_theme = { "hicolor" },
+        .active_accent = { accent },
+        .inactive_accent = { accent },
+        .shadow_radius = { 0 },
+        .shadow_spread = { 0 },
+        .shadow_color = { wf::color_t{ 0.0, 0.0, 0.0, 0.5 } },
+        .padding_size = { 8 },
+        .layout = { "a | icon P4 title | minimize p maximize p close p | Atrtl -" },
+        .ignore_views = { "none" },
+        .debug_mode = { false },
+        .round_on = { "all" },
+        .quality = { "full" },
+    };
+}
+}
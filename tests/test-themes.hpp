@@ -0,0 +1,27 @@
+#pragma once
+
+#include "firedecor-theme.hpp"
+
+namespace stubs {
+/** The kinds of themes the tests and benchmarks draw decorations with */
+enum theme_kind_t {
+    /** The default theme: rounded corners, accents, an icon and three buttons */
+    THEME_PLAIN,
+    /** The default theme, with an outline around the border */
+    THEME_OUTLINE,
+    /** The default theme, with rounded corners, drawn over a border image */
+    THEME_BORDER_IMAGE,
+};
+
+/** The app id whose icon is set up by setup_home() */
+extern const char *app_id;
+
+/**
+ * Point HOME to a new directory, holding the icon of app_id and the border
+ * image, so that themes never look beyond it.
+ */
+void setup_home();
+
+/** @return The options of a theme of the kind, as the metadata defaults them */
+wf::firedecor::theme_options make_theme(theme_kind_t kind);
+}